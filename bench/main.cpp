@@ -0,0 +1,216 @@
+/**
+ * @file main.cpp
+ * @brief Host benchmarks of the libraries, built by env:bench (see platformio.ini) against the
+ *        stand-ins in host/. Progress goes to stderr and the results to stdout, as JSON:
+ *
+ *        {"benchmarks":[{"name":"logger.throughput","unit":"lines/s","value":123456.0,"better":"higher"}, ...]}
+ *
+ *        The SD card is a temporary directory (BENCH_SD_ROOT to use another one), so the figures
+ *        measure the libraries' own cost on the host, not the card or the UART of a device.
+ */
+
+#include "header.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BENCH_LOG_LINES 20000                     // Lines pushed through the logger
+#define BENCH_LOG_IN_FLIGHT 64                    // Lines queued at most, so none are dropped
+#define BENCH_SCAN_RUNS 5                         // Program scans per tree size; the median is reported
+#define BENCH_FIRMWARE_SIZE (4UL * 1024UL * 1024UL) // Image streamed by the firmware benchmark
+
+static const size_t scanSizes[] = {10, 100, 1000}; // Program folders in /Programs
+
+static char sdRoot[256];
+static bool firstResult = true;
+
+// Writes one entry of the "benchmarks" array
+static void printResult(const char* name, const char* unit, double value, bool higherIsBetter) {
+    printf("%s\n    {\"name\":\"%s\",\"unit\":\"%s\",\"value\":%.3f,\"better\":\"%s\"}", firstResult ? "" : ",", name, unit, value, higherIsBetter ? "higher" : "lower");
+    firstResult = false;
+    fprintf(stderr, "%-28s %14.3f %s\n", name, value, unit);
+}
+
+// Host path of a path on the card
+static std::string hostPath(const char* path) {
+    return std::string(sdRoot) + path;
+}
+
+static bool writeHostFile(const std::string &path, size_t size) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) return false;
+    std::vector<uint8_t> chunk(4096);
+    for (size_t i = 0; i < chunk.size(); i++) chunk[i] = (uint8_t)(i * 31 + 7);
+    for (size_t written = 0; written < size; written += chunk.size()) {
+        fwrite(chunk.data(), 1, std::min(chunk.size(), size - written), file);
+    }
+    fclose(file);
+    return true;
+}
+
+// Collects text written through Print, e.g. a metrics page
+class StringPrint : public Print {
+    public:
+        size_t write(uint8_t c) override { text += (char)c; return 1; }
+        size_t write(const uint8_t* buffer, size_t size) override { text.append((const char*)buffer, size); return size; }
+        using Print::write;
+
+        // Value of a metric line "name value", or -1 if it is missing
+        double metric(const char* name) const {
+            std::string prefix = "\n" + std::string(name) + " "; // Not the "# HELP name" line
+            size_t position = ("\n" + text).find(prefix);
+            return position == std::string::npos ? -1 : atof(text.c_str() + position + prefix.size() - 1);
+        }
+
+        std::string text;
+};
+
+static void loggerTask(void* parameters) {
+    static_cast<LoggerLib*>(parameters)->taskLog(nullptr);
+}
+
+// Lines per second through the queue, the formatter and the batched SD writes
+static void benchLogger(StorageLib &storage) {
+    static LoggerLib logger(&storage); // The logging task never returns, so the logger must outlive this function
+    if (!logger.beginLogFiles()) {
+        fprintf(stderr, "logger: could not open the log files\n");
+        return;
+    }
+    TaskHandle_t task = nullptr;
+    xTaskCreate(loggerTask, "HandleLogging", 4096, &logger, 1, &task);
+
+    // One line first, so the task is running (and its allocations are counted apart) before measuring
+    logger.log(LOGGER_LEVEL_INFO, "BENCH", "logger benchmark started");
+    while (logger.getStats().written == 0) {
+        taskYIELD();
+    }
+
+    LoggerStats before = logger.getStats();
+    uint32_t allocationsBefore = EssentialsLib::getHeapAllocCount(task);
+    uint32_t start = micros();
+    for (uint32_t sent = 0; sent < BENCH_LOG_LINES; sent++) {
+        while (sent - (logger.getStats().written - before.written) >= BENCH_LOG_IN_FLIGHT) {
+            taskYIELD();
+        }
+        // Every line differs, so none are folded into a repeat count
+        logger.log(LOGGER_LEVEL_INFO, "BENCH", "line %lu of the logger benchmark, value=%d", (unsigned long)sent, (int)(sent * 7 % 1000));
+    }
+    while (logger.getStats().written - before.written < BENCH_LOG_LINES) {
+        taskYIELD();
+    }
+    uint32_t elapsed = micros() - start;
+    uint32_t allocations = EssentialsLib::getHeapAllocCount(task) - allocationsBefore;
+
+    LoggerStats after = logger.getStats();
+    printResult("logger.throughput", "lines/s", BENCH_LOG_LINES * 1e6 / elapsed, true);
+    printResult("logger.line_latency", "us/line", (double)elapsed / BENCH_LOG_LINES, false);
+    printResult("logger.batches", "batches", after.batches - before.batches, false);
+    printResult("logger.dropped", "lines", (after.queueFull - before.queueFull) + (after.rateLimited - before.rateLimited), false);
+    if (EssentialsLib::isHeapAllocCounterEnabled()) {
+        // Everything the logging task allocated, batched SD writes included, not just the last line
+        printResult("logger.allocations_per_line", "allocations", (double)allocations / BENCH_LOG_LINES, false);
+    }
+}
+
+static void countProgram(const char*, void* context) {
+    (*static_cast<size_t*>(context))++;
+}
+
+// Time to list /Programs, which the main menu does at every boot
+static void benchProgramScan(LoaderLib &loader) {
+    size_t created = 0;
+    for (size_t size : scanSizes) {
+        for (; created < size; created++) {
+            char folder[64];
+            snprintf(folder, sizeof(folder), "/Programs/Program %04u", (unsigned)created);
+            ::mkdir(hostPath(folder).c_str(), 0777);
+            writeHostFile(hostPath(folder) + "/firmware.bin", 1024);
+            writeHostFile(hostPath(folder) + "/index.html", 256);
+        }
+
+        std::vector<uint32_t> runs;
+        for (int run = 0; run < BENCH_SCAN_RUNS; run++) {
+            size_t found = 0;
+            uint32_t start = micros();
+            loader.forEachProgram(countProgram, &found);
+            runs.push_back(micros() - start);
+            if (found != size) {
+                fprintf(stderr, "scan: found %u of %u programs\n", (unsigned)found, (unsigned)size);
+            }
+        }
+        std::sort(runs.begin(), runs.end());
+
+        char name[48];
+        snprintf(name, sizeof(name), "loader.scan_%u_programs", (unsigned)size);
+        printResult(name, "ms", runs[runs.size() / 2] / 1000.0, false);
+    }
+}
+
+// Streams an image through LoaderLib::update(), from the card to Update, as a flash would
+static void benchFirmware(LoaderLib &loader) {
+    ::mkdir(hostPath("/Programs/Bench Firmware").c_str(), 0777);
+    writeHostFile(hostPath("/Programs/Bench Firmware/firmware.bin"), BENCH_FIRMWARE_SIZE);
+    setenv("HOST_UPDATE_PATH", hostPath("/update.bin").c_str(), 1);
+
+    // The update ends in a restart; on the host it unwinds back here instead
+    ESP.setRestartThrows(true);
+    try {
+        loader.update("Programs/Bench Firmware");
+    } catch (const HostRestart&) {
+    }
+    ESP.setRestartThrows(false);
+
+    StringPrint metrics;
+    loader.printMetrics(metrics);
+    double bytesPerSecond = metrics.metric(METRICS_PREFIX "firmware_update_bytes_per_second");
+    if (bytesPerSecond < 0 || metrics.metric(METRICS_PREFIX "firmware_update_success") != 1) {
+        fprintf(stderr, "firmware: update did not complete\n");
+        return;
+    }
+    printResult("firmware.stream", "MB/s", bytesPerSecond / (1024.0 * 1024.0), true);
+    printResult("firmware.stream_time", "ms", metrics.metric(METRICS_PREFIX "firmware_update_duration_seconds") * 1000.0, false);
+}
+
+int main() {
+    setenv("HOST_SERIAL_QUIET", "1", 0); // Serial would measure the terminal, not the logger
+
+    const char* root = getenv("BENCH_SD_ROOT");
+    bool temporary = root == nullptr;
+    if (temporary) {
+        snprintf(sdRoot, sizeof(sdRoot), "/tmp/multilauncher-bench-XXXXXX");
+        if (mkdtemp(sdRoot) == nullptr) {
+            perror("mkdtemp");
+            return 1;
+        }
+    } else {
+        snprintf(sdRoot, sizeof(sdRoot), "%s", root);
+    }
+    ::mkdir(hostPath("/log").c_str(), 0777);
+    ::mkdir(hostPath("/Old logs").c_str(), 0777);
+    ::mkdir(hostPath("/Programs").c_str(), 0777);
+    SD.setRoot(sdRoot);
+    SD_MMC.setRoot(sdRoot);
+
+    StorageLib storage(CS_PIN, MISO_PIN, MOSI_PIN, CLK_PIN);
+    LoaderLib loader(&storage);
+    if (!loader.begin()) {
+        fprintf(stderr, "Could not mount %s\n", sdRoot);
+        return 1;
+    }
+
+    printf("{\"benchmarks\":[");
+    benchLogger(storage);
+    benchProgramScan(loader);
+    benchFirmware(loader);
+    printf("\n]}\n");
+    fflush(stdout);
+
+    if (temporary) {
+        std::error_code error;
+        std::filesystem::remove_all(sdRoot, error);
+    }
+    _exit(0); // The logging task never returns; skip joining it and the static destructors
+}
@@ -0,0 +1,74 @@
+/**
+ * @file Arduino.h
+ * @brief Host stand-in for the ESP32 Arduino core: timing, Serial, ESP and the FreeRTOS headers.
+ */
+
+#ifndef HOST_ARDUINO
+#define HOST_ARDUINO
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include "WString.h"
+#include "Print.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#define HOST_NATIVE 1
+#define RTC_NOINIT_ATTR // Host memory does not survive a restart anyway
+
+using std::min;
+using std::max;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+/** @brief Serial port stand-in that writes to stdout, or nowhere when HOST_SERIAL_QUIET is set. */
+class HardwareSerial : public Stream {
+    public:
+        void begin(unsigned long) {}
+        operator bool() const { return true; }
+        size_t write(uint8_t c) override;
+        size_t write(const uint8_t* buf, size_t size) override;
+        int available() override { return 0; }
+        int read() override { return -1; }
+        using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+/**
+ * @brief Thrown by ESP.restart() once setRestartThrows(true) has been called, so a host program
+ *        (a benchmark, say) can run code that ends in a restart and carry on.
+ */
+struct HostRestart {};
+
+/** @brief Stand-in for the ESP class; heap figures are fixed values typical of an ESP32-S3. */
+class EspClass {
+    public:
+        uint32_t getHeapSize();
+        uint32_t getFreeHeap();
+        uint32_t getMinFreeHeap();
+        uint32_t getMaxAllocHeap();
+        uint32_t getPsramSize() { return 0; }
+        uint32_t getFreePsram() { return 0; }
+        [[noreturn]] void restart();
+
+        /** @brief Host only: makes restart() throw HostRestart instead of exiting the process. */
+        void setRestartThrows(bool throws) { _restartThrows = throws; }
+
+    private:
+        bool _restartThrows = false;
+};
+
+extern EspClass ESP;
+
+#endif // HOST_ARDUINO
@@ -0,0 +1,82 @@
+/**
+ * @file HostArduino.cpp
+ * @brief Timing, Serial and ESP implementations for the host stand-in.
+ */
+
+#include "Arduino.h"
+#include "esp_timer.h"
+
+#include <chrono>
+#include <thread>
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point startTime = Clock::now();
+
+    // Read on first use rather than at static initialisation, so main() can still set it
+    bool serialQuiet() {
+        static const bool quiet = getenv("HOST_SERIAL_QUIET") != nullptr;
+        return quiet;
+    }
+}
+
+HardwareSerial Serial;
+EspClass ESP;
+
+unsigned long millis() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - startTime).count();
+}
+
+unsigned long micros() {
+    return (unsigned long)esp_timer_get_time();
+}
+
+int64_t esp_timer_get_time() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - startTime).count();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    if (!serialQuiet()) fputc(c, stdout);
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t size) {
+    if (!serialQuiet()) {
+        fwrite(buf, 1, size, stdout);
+        fflush(stdout);
+    }
+    return size;
+}
+
+uint32_t EspClass::getHeapSize() { return 320 * 1024; }
+uint32_t EspClass::getFreeHeap() { return 200 * 1024; }
+uint32_t EspClass::getMinFreeHeap() { return 200 * 1024; }
+uint32_t EspClass::getMaxAllocHeap() { return 110 * 1024; }
+
+void EspClass::restart() {
+    fflush(stdout);
+    if (_restartThrows) {
+        throw HostRestart();
+    }
+    exit(0);
+}
+
+// Sketch entry points; a benchmark or tool that brings its own main() replaces this one.
+void setup() __attribute__((weak));
+void loop() __attribute__((weak));
+
+__attribute__((weak)) int main() {
+    if (setup) setup();
+    while (true) {
+        if (loop) loop();
+        delay(1);
+    }
+}
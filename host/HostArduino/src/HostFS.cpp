@@ -0,0 +1,233 @@
+/**
+ * @file HostFS.cpp
+ * @brief fs::FS stand-in backed by stdio and dirent on the host.
+ */
+
+#include "FS.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs {
+
+class FileImpl {
+    public:
+        FileImpl(const char* hostPath, const char* cardPath, FILE* f, DIR* d) : file(f), dir(d) {
+            snprintf(this->hostPath, sizeof(this->hostPath), "%s", hostPath);
+            snprintf(this->cardPath, sizeof(this->cardPath), "%s", cardPath);
+            const char* slash = strrchr(this->cardPath, '/');
+            baseName = slash ? slash + 1 : this->cardPath;
+        }
+        ~FileImpl() { close(); }
+        void close() {
+            if (file) fclose(file);
+            if (dir) closedir(dir);
+            file = nullptr;
+            dir = nullptr;
+        }
+
+        FILE* file;
+        DIR* dir;
+        char hostPath[512];
+        char cardPath[384];
+        const char* baseName;
+};
+
+size_t File::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t File::write(const uint8_t* buf, size_t size) {
+    if (!_p || !_p->file) return 0;
+    return fwrite(buf, 1, size, _p->file);
+}
+
+int File::available() {
+    if (!_p || !_p->file) return 0;
+    long pos = ftell(_p->file);
+    return pos < 0 ? 0 : (int)(size() - (size_t)pos);
+}
+
+int File::read() {
+    if (!_p || !_p->file) return -1;
+    int c = fgetc(_p->file);
+    return c == EOF ? -1 : c;
+}
+
+int File::peek() {
+    if (!_p || !_p->file) return -1;
+    int c = fgetc(_p->file);
+    if (c == EOF) return -1;
+    ungetc(c, _p->file);
+    return c;
+}
+
+void File::flush() {
+    if (_p && _p->file) fflush(_p->file);
+}
+
+size_t File::read(uint8_t* buf, size_t size) {
+    if (!_p || !_p->file) return 0;
+    return fread(buf, 1, size, _p->file);
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+    if (!_p || !_p->file) return false;
+    int whence = mode == SeekSet ? SEEK_SET : (mode == SeekCur ? SEEK_CUR : SEEK_END);
+    return fseek(_p->file, (long)pos, whence) == 0;
+}
+
+size_t File::position() const {
+    if (!_p || !_p->file) return 0;
+    long pos = ftell(_p->file);
+    return pos < 0 ? 0 : (size_t)pos;
+}
+
+size_t File::size() const {
+    if (!_p) return 0;
+    if (_p->file) {
+        fflush(_p->file);
+        struct stat st;
+        if (fstat(fileno(_p->file), &st) == 0) return (size_t)st.st_size;
+    }
+    return 0;
+}
+
+bool File::setBufferSize(size_t size) {
+    if (!_p || !_p->file) return false;
+    return setvbuf(_p->file, nullptr, _IOFBF, size) == 0;
+}
+
+void File::close() {
+    if (_p) _p->close();
+    _p.reset();
+}
+
+File::operator bool() const {
+    return _p && (_p->file || _p->dir);
+}
+
+time_t File::getLastWrite() {
+    if (!_p) return 0;
+    struct stat st;
+    return stat(_p->hostPath, &st) == 0 ? st.st_mtime : 0;
+}
+
+const char* File::path() const {
+    return _p ? _p->cardPath : nullptr;
+}
+
+const char* File::name() const {
+    return _p ? _p->baseName : nullptr;
+}
+
+bool File::isDirectory() {
+    return _p && _p->dir;
+}
+
+File File::openNextFile(const char* mode) {
+    if (!_p || !_p->dir) return File();
+    struct dirent* entry;
+    while ((entry = readdir(_p->dir)) != nullptr) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        // Entries whose paths would not fit are skipped rather than opened under a truncated name
+        char cardPath[384];
+        const char* sep = (strcmp(_p->cardPath, "/") == 0) ? "" : "/";
+        int length = snprintf(cardPath, sizeof(cardPath), "%s%s%s", _p->cardPath, sep, entry->d_name);
+        if (length < 0 || (size_t)length >= sizeof(cardPath)) continue;
+        char hostPath[512];
+        length = snprintf(hostPath, sizeof(hostPath), "%s/%s", _p->hostPath, entry->d_name);
+        if (length < 0 || (size_t)length >= sizeof(hostPath)) continue;
+        struct stat st;
+        if (stat(hostPath, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            DIR* d = opendir(hostPath);
+            if (d) return File(std::make_shared<FileImpl>(hostPath, cardPath, nullptr, d));
+        } else {
+            FILE* f = fopen(hostPath, strcmp(mode, FILE_READ) == 0 ? "rb" : "r+b");
+            if (f) return File(std::make_shared<FileImpl>(hostPath, cardPath, f, nullptr));
+        }
+    }
+    return File();
+}
+
+void File::rewindDirectory() {
+    if (_p && _p->dir) rewinddir(_p->dir);
+}
+
+FS::FS(const char* root) {
+    setRoot(root);
+}
+
+void FS::setRoot(const char* root) {
+    if (!root) root = getenv("HOST_SD_ROOT");
+    snprintf(_root, sizeof(_root), "%s", root ? root : "sdcard");
+}
+
+void FS::_hostPath(const char* path, char* out, size_t outSize) const {
+    snprintf(out, outSize, "%s%s%s", _root, (path[0] == '/') ? "" : "/", path);
+    size_t len = strlen(out);
+    while (len > strlen(_root) && out[len - 1] == '/') out[--len] = 0;
+}
+
+File FS::open(const char* path, const char* mode, const bool create) {
+    char hostPath[384];
+    _hostPath(path, hostPath, sizeof(hostPath));
+    struct stat st;
+    bool exists = stat(hostPath, &st) == 0;
+    if (exists && S_ISDIR(st.st_mode)) {
+        DIR* d = opendir(hostPath);
+        return d ? File(std::make_shared<FileImpl>(hostPath, path, nullptr, d)) : File();
+    }
+    if (create) {
+        // Mirror the ESP32 VFS: create missing parent directories on request.
+        for (char* p = hostPath + strlen(_root) + 1; *p; p++) {
+            if (*p == '/') { *p = 0; ::mkdir(hostPath, 0777); *p = '/'; }
+        }
+    }
+    const char* hostMode = "rb";
+    if (strcmp(mode, FILE_WRITE) == 0) hostMode = "w+b";
+    else if (strcmp(mode, FILE_APPEND) == 0) hostMode = "a+b";
+    else if (!exists) return File();
+    FILE* f = fopen(hostPath, hostMode);
+    return f ? File(std::make_shared<FileImpl>(hostPath, path, f, nullptr)) : File();
+}
+
+bool FS::exists(const char* path) {
+    char hostPath[384];
+    _hostPath(path, hostPath, sizeof(hostPath));
+    struct stat st;
+    return stat(hostPath, &st) == 0;
+}
+
+bool FS::remove(const char* path) {
+    char hostPath[384];
+    _hostPath(path, hostPath, sizeof(hostPath));
+    return ::unlink(hostPath) == 0;
+}
+
+bool FS::rename(const char* pathFrom, const char* pathTo) {
+    char from[384];
+    char to[384];
+    _hostPath(pathFrom, from, sizeof(from));
+    _hostPath(pathTo, to, sizeof(to));
+    // FAT refuses to rename over an existing file; keep that behaviour.
+    struct stat st;
+    if (stat(to, &st) == 0) return false;
+    return ::rename(from, to) == 0;
+}
+
+bool FS::mkdir(const char* path) {
+    char hostPath[384];
+    _hostPath(path, hostPath, sizeof(hostPath));
+    return ::mkdir(hostPath, 0777) == 0;
+}
+
+bool FS::rmdir(const char* path) {
+    char hostPath[384];
+    _hostPath(path, hostPath, sizeof(hostPath));
+    return ::rmdir(hostPath) == 0;
+}
+
+} // namespace fs
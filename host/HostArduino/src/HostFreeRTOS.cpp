@@ -0,0 +1,267 @@
+/**
+ * @file HostFreeRTOS.cpp
+ * @brief std::thread based implementation of the FreeRTOS stand-in.
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point bootTime = Clock::now();
+
+    std::recursive_mutex criticalMutex;
+    std::atomic<unsigned> taskCount(1);
+
+    /// Converts a tick count into an absolute deadline; portMAX_DELAY never expires.
+    bool waitFor(std::unique_lock<std::mutex>& lock, std::condition_variable& cv, TickType_t ticks, const std::function<bool()>& ready) {
+        if (ticks == portMAX_DELAY) {
+            cv.wait(lock, ready);
+            return true;
+        }
+        return cv.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+    }
+}
+
+struct HostTask {
+    char name[16];
+    TaskFunction_t fn;
+    void* param;
+};
+
+namespace {
+    HostTask mainTask = {"main", nullptr, nullptr};
+    thread_local HostTask* currentTask = &mainTask;
+}
+
+void hostEnterCritical(portMUX_TYPE*) { criticalMutex.lock(); }
+void hostExitCritical(portMUX_TYPE*) { criticalMutex.unlock(); }
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - bootTime).count();
+}
+
+BaseType_t xPortGetCoreID() {
+    return 0;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t, void* param, UBaseType_t, TaskHandle_t* handle, BaseType_t) {
+    HostTask* task = new HostTask();
+    snprintf(task->name, sizeof(task->name), "%s", name ? name : "");
+    task->fn = fn;
+    task->param = param;
+    if (handle) *handle = task;
+    taskCount++;
+    std::thread([task]() {
+        currentTask = task;
+        task->fn(task->param);
+        taskCount--;
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* param, UBaseType_t priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(fn, name, stackDepth, param, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == nullptr || task == currentTask) {
+        taskCount--;
+        pthread_exit(nullptr);
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+void taskYIELD() {
+    std::this_thread::yield();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return currentTask;
+}
+
+const char* pcTaskGetName(TaskHandle_t task) {
+    return (task ? task : currentTask)->name;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) {
+    return 0;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks() {
+    return taskCount;
+}
+
+// Queues copy items into a ring preallocated at creation, like the real kernel.
+struct HostQueue {
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::vector<uint8_t> storage;
+    size_t itemSize;
+    size_t length;
+    size_t head = 0;
+    size_t count = 0;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    HostQueue* queue = new HostQueue();
+    queue->storage.resize((size_t)length * itemSize);
+    queue->itemSize = itemSize;
+    queue->length = length;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!waitFor(lock, queue->notFull, wait, [queue]() { return queue->count < queue->length; })) return errQUEUE_FULL;
+    size_t slot = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->storage[slot * queue->itemSize], item, queue->itemSize);
+    queue->count++;
+    queue->notEmpty.notify_one();
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!waitFor(lock, queue->notEmpty, wait, [queue]() { return queue->count > 0; })) return pdFALSE;
+    memcpy(item, &queue->storage[queue->head * queue->itemSize], queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    queue->notFull.notify_one();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->length - queue->count;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+struct HostSemaphore {
+    std::mutex mutex;
+    std::condition_variable cv;
+    UBaseType_t count;
+    UBaseType_t max;
+    HostTask* owner = nullptr;
+    UBaseType_t depth = 0;
+};
+
+namespace {
+    SemaphoreHandle_t createSemaphore(UBaseType_t max, UBaseType_t initial) {
+        HostSemaphore* sem = new HostSemaphore();
+        sem->max = max;
+        sem->count = initial;
+        return sem;
+    }
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return createSemaphore(1, 1); }
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return createSemaphore(1, 1); }
+SemaphoreHandle_t xSemaphoreCreateBinary() { return createSemaphore(1, 0); }
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial) { return createSemaphore(max, initial); }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait) {
+    std::unique_lock<std::mutex> lock(sem->mutex);
+    if (!waitFor(lock, sem->cv, wait, [sem]() { return sem->count > 0; })) return pdFALSE;
+    sem->count--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    std::lock_guard<std::mutex> lock(sem->mutex);
+    if (sem->count >= sem->max) return pdFALSE;
+    sem->count++;
+    sem->cv.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t wait) {
+    std::unique_lock<std::mutex> lock(sem->mutex);
+    if (sem->owner == currentTask) {
+        sem->depth++;
+        return pdTRUE;
+    }
+    if (!waitFor(lock, sem->cv, wait, [sem]() { return sem->count > 0; })) return pdFALSE;
+    sem->count--;
+    sem->owner = currentTask;
+    sem->depth = 1;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem) {
+    std::lock_guard<std::mutex> lock(sem->mutex);
+    if (sem->owner != currentTask) return pdFALSE;
+    if (--sem->depth == 0) {
+        sem->owner = nullptr;
+        sem->count++;
+        sem->cv.notify_one();
+    }
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    delete sem;
+}
+
+struct HostEventGroup {
+    std::mutex mutex;
+    std::condition_variable cv;
+    EventBits_t bits = 0;
+};
+
+EventGroupHandle_t xEventGroupCreate() {
+    return new HostEventGroup();
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    group->bits |= bits;
+    group->cv.notify_all();
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clearOnExit, BaseType_t waitForAll, TickType_t wait) {
+    std::unique_lock<std::mutex> lock(group->mutex);
+    auto ready = [group, bits, waitForAll]() {
+        return waitForAll ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+    };
+    bool satisfied = waitFor(lock, group->cv, wait, ready);
+    EventBits_t result = group->bits;
+    if (satisfied && clearOnExit) group->bits &= ~bits;
+    return result;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file HostSD.cpp
+ * @brief SD, SD_MMC and SPI globals for the host stand-in.
+ */
+
+#include "SD.h"
+#include "SD_MMC.h"
+
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+fs::SDFS SD;
+fs::SDMMCFS SD_MMC;
+SPIClass SPI;
+
+namespace fs {
+
+bool SDFS::begin(uint8_t, SPIClass&, uint32_t, const char*, uint8_t, bool) {
+    struct stat st;
+    _mounted = stat(root(), &st) == 0 && S_ISDIR(st.st_mode);
+    return _mounted;
+}
+
+// The card's capacity is the host filesystem's under the root directory
+static uint64_t hostTotalBytes(const char* root) {
+    struct statvfs st;
+    return statvfs(root, &st) == 0 ? (uint64_t)st.f_blocks * st.f_frsize : 0;
+}
+
+static uint64_t hostUsedBytes(const char* root) {
+    struct statvfs st;
+    return statvfs(root, &st) == 0 ? (uint64_t)(st.f_blocks - st.f_bavail) * st.f_frsize : 0;
+}
+
+uint64_t SDFS::totalBytes() { return hostTotalBytes(root()); }
+uint64_t SDFS::usedBytes() { return hostUsedBytes(root()); }
+uint64_t SDMMCFS::totalBytes() { return hostTotalBytes(root()); }
+uint64_t SDMMCFS::usedBytes() { return hostUsedBytes(root()); }
+
+bool SDMMCFS::begin(const char*, bool, bool, int, uint8_t) {
+    struct stat st;
+    _mounted = stat(root(), &st) == 0 && S_ISDIR(st.st_mode);
+    return _mounted;
+}
+
+} // namespace fs
@@ -0,0 +1,56 @@
+/**
+ * @file HostUpdate.cpp
+ * @brief File-backed implementation of the Update stand-in.
+ */
+
+#include "Update.h"
+
+UpdateClass Update;
+
+bool UpdateClass::begin(size_t size) {
+    const char* path = getenv("HOST_UPDATE_PATH");
+    _file = fopen(path ? path : "update.bin", "wb");
+    _size = size;
+    _progress = 0;
+    _finished = false;
+    _error = _file ? UPDATE_ERROR_OK : UPDATE_ERROR_WRITE;
+    return _file != nullptr;
+}
+
+size_t UpdateClass::write(uint8_t* data, size_t len) {
+    if (!_file || _error) return 0;
+    size_t written = fwrite(data, 1, len, _file);
+    _progress += written;
+    if (written != len) _error = UPDATE_ERROR_WRITE;
+    return written;
+}
+
+size_t UpdateClass::writeStream(Stream& data) {
+    // Same chunk size as the ESP32 core (one flash sector).
+    uint8_t buffer[4096];
+    size_t total = 0;
+    while (_progress < _size) {
+        size_t want = _size - _progress < sizeof(buffer) ? _size - _progress : sizeof(buffer);
+        size_t got = data.readBytes(buffer, want);
+        if (got == 0) {
+            _error = UPDATE_ERROR_STREAM;
+            break;
+        }
+        size_t written = write(buffer, got);
+        total += written;
+        if (written != got) break;
+    }
+    return total;
+}
+
+bool UpdateClass::end(bool evenIfRemaining) {
+    if (!_file) return false;
+    fclose(_file);
+    _file = nullptr;
+    if (!evenIfRemaining && _progress != _size) {
+        _error = UPDATE_ERROR_SIZE;
+        return false;
+    }
+    _finished = _error == UPDATE_ERROR_OK;
+    return _finished;
+}
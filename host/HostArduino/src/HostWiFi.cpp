@@ -0,0 +1,121 @@
+/**
+ * @file HostWiFi.cpp
+ * @brief POSIX socket implementation of the WiFiServer/WiFiClient stand-ins.
+ */
+
+#include "WiFi.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+
+WiFiClass WiFi;
+
+WiFiClient::Socket::~Socket() {
+    if (fd >= 0) ::close(fd);
+}
+
+WiFiClient::WiFiClient(int fd) : _sock(std::make_shared<Socket>(fd)) {}
+
+uint8_t WiFiClient::connected() {
+    if (!_sock || _sock->fd < 0) return 0;
+    char c;
+    ssize_t n = recv(_sock->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n == 0) return 0;
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) return 0;
+    return 1;
+}
+
+int WiFiClient::available() {
+    if (!_sock || _sock->fd < 0) return 0;
+    int count = 0;
+    if (ioctl(_sock->fd, FIONREAD, &count) < 0) return 0;
+    return count;
+}
+
+int WiFiClient::read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buf, size_t size) {
+    if (!_sock || _sock->fd < 0) return -1;
+    ssize_t n = recv(_sock->fd, buf, size, MSG_DONTWAIT);
+    return n < 0 ? -1 : (int)n;
+}
+
+size_t WiFiClient::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t WiFiClient::write(const uint8_t* buf, size_t size) {
+    if (!_sock || _sock->fd < 0) return 0;
+    size_t sent = 0;
+    while (sent < size) {
+        ssize_t n = send(_sock->fd, buf + sent, size - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            break;
+        }
+        sent += (size_t)n;
+    }
+    return sent;
+}
+
+void WiFiClient::stop() {
+    if (_sock && _sock->fd >= 0) {
+        shutdown(_sock->fd, SHUT_WR);
+        ::close(_sock->fd);
+        _sock->fd = -1;
+    }
+    _sock.reset();
+}
+
+void WiFiClient::setTimeout(uint32_t seconds) {
+    _timeoutSeconds = seconds;
+    if (_sock && _sock->fd >= 0) {
+        struct timeval tv = {(time_t)seconds, 0};
+        setsockopt(_sock->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+}
+
+void WiFiServer::begin(uint16_t port) {
+    if (port) _port = port;
+    const char* override = getenv("HOST_HTTP_PORT");
+    if (override) _port = (uint16_t)atoi(override);
+
+    _fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(_port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(_fd, 16) < 0) {
+        fprintf(stderr, "WiFiServer: cannot listen on port %u\n", _port);
+        ::close(_fd);
+        _fd = -1;
+        return;
+    }
+    fcntl(_fd, F_SETFL, O_NONBLOCK);
+}
+
+WiFiClient WiFiServer::accept() {
+    if (_fd < 0) return WiFiClient();
+    int fd = ::accept(_fd, nullptr, nullptr);
+    if (fd < 0) return WiFiClient();
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return WiFiClient(fd);
+}
+
+void WiFiServer::end() {
+    if (_fd >= 0) ::close(_fd);
+    _fd = -1;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file Print.h
+ * @brief Host stand-in for the Arduino Print/Stream interfaces.
+ */
+
+#ifndef HOST_PRINT
+#define HOST_PRINT
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include "WString.h"
+
+class Print {
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t* buf, size_t size) {
+            size_t n = 0;
+            while (size--) n += write(*buf++);
+            return n;
+        }
+        size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+        size_t write(const char* buf, size_t size) { return write((const uint8_t*)buf, size); }
+        size_t print(const char* s) { return write(s); }
+        size_t print(const String& s) { return write((const uint8_t*)s.c_str(), s.length()); }
+        size_t print(char c) { return write((uint8_t)c); }
+        size_t print(long v) { return print(String(v)); }
+        size_t print(unsigned long v) { return print(String(v)); }
+        size_t print(int v) { return print(String(v)); }
+        size_t print(unsigned int v) { return print(String(v)); }
+        size_t println() { return write("\r\n"); }
+        template <typename T> size_t println(const T& v) { size_t n = print(v); return n + println(); }
+        size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+            char buf[256];
+            va_list args;
+            va_start(args, fmt);
+            int len = vsnprintf(buf, sizeof(buf), fmt, args);
+            va_end(args);
+            if (len < 0) return 0;
+            return write((const uint8_t*)buf, (size_t)len < sizeof(buf) ? (size_t)len : sizeof(buf) - 1);
+        }
+        virtual void flush() {}
+};
+
+class Stream : public Print {
+    public:
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() { return -1; }
+        virtual size_t readBytes(uint8_t* buf, size_t len) {
+            size_t n = 0;
+            while (n < len) { int c = read(); if (c < 0) break; buf[n++] = (uint8_t)c; }
+            return n;
+        }
+        size_t readBytes(char* buf, size_t len) { return readBytes((uint8_t*)buf, len); }
+        String readStringUntil(char terminator) {
+            String s;
+            int c;
+            while ((c = read()) >= 0 && c != terminator) s += (char)c;
+            return s;
+        }
+        void setTimeout(unsigned long timeout) { _timeout = timeout; }
+
+    protected:
+        unsigned long _timeout = 1000;
+};
+
+#endif // HOST_PRINT
@@ -0,0 +1,33 @@
+/**
+ * @file SD.h
+ * @brief Host stand-in for the ESP32 SD library; the card is a host directory (HOST_SD_ROOT, default ./sdcard).
+ */
+
+#ifndef HOST_SD
+#define HOST_SD
+
+#include <FS.h>
+#include <SPI.h>
+
+typedef enum { CARD_NONE, CARD_MMC, CARD_SD, CARD_SDHC, CARD_UNKNOWN } sdcard_type_t;
+
+namespace fs {
+
+class SDFS : public FS {
+    public:
+        bool begin(uint8_t ssPin = 5, SPIClass& spi = SPI, uint32_t frequency = 4000000, const char* mountpoint = "/sd", uint8_t max_files = 5, bool format_if_empty = false);
+        void end() { _mounted = false; }
+        sdcard_type_t cardType() { return _mounted ? CARD_SDHC : CARD_NONE; }
+        uint64_t cardSize() { return 16ULL * 1024 * 1024 * 1024; }
+        uint64_t totalBytes();
+        uint64_t usedBytes();
+
+    private:
+        bool _mounted = false;
+};
+
+} // namespace fs
+
+extern fs::SDFS SD;
+
+#endif // HOST_SD
@@ -0,0 +1,34 @@
+/**
+ * @file SD_MMC.h
+ * @brief Host stand-in for the ESP32 SD_MMC library; shares the host directory with SD.
+ */
+
+#ifndef HOST_SD_MMC
+#define HOST_SD_MMC
+
+#include <SD.h>
+
+#define SDMMC_FREQ_DEFAULT 20000
+#define SDMMC_FREQ_HIGHSPEED 40000
+
+namespace fs {
+
+class SDMMCFS : public FS {
+    public:
+        bool setPins(int clk, int cmd, int d0, int d1 = -1, int d2 = -1, int d3 = -1) { (void)clk; (void)cmd; (void)d0; (void)d1; (void)d2; (void)d3; return true; }
+        bool begin(const char* mountpoint = "/sdcard", bool mode1bit = false, bool format_if_mount_failed = false, int sdmmc_frequency = SDMMC_FREQ_DEFAULT, uint8_t maxOpenFiles = 5);
+        void end() { _mounted = false; }
+        sdcard_type_t cardType() { return _mounted ? CARD_SDHC : CARD_NONE; }
+        uint64_t cardSize() { return 16ULL * 1024 * 1024 * 1024; }
+        uint64_t totalBytes();
+        uint64_t usedBytes();
+
+    private:
+        bool _mounted = false;
+};
+
+} // namespace fs
+
+extern fs::SDMMCFS SD_MMC;
+
+#endif // HOST_SD_MMC
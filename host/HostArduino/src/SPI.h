@@ -0,0 +1,20 @@
+/**
+ * @file SPI.h
+ * @brief Host stand-in for the SPI bus used to mount the SD card.
+ */
+
+#ifndef HOST_SPI
+#define HOST_SPI
+
+#include <Arduino.h>
+
+/** @brief SPI bus stand-in; the host SD card has no bus to configure. */
+class SPIClass {
+    public:
+        void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1) { (void)sck; (void)miso; (void)mosi; (void)ss; }
+        void end() {}
+};
+
+extern SPIClass SPI;
+
+#endif // HOST_SPI
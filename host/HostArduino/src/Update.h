@@ -0,0 +1,42 @@
+/**
+ * @file Update.h
+ * @brief Host stand-in for the ESP32 Update (OTA) class; the image is written to a host file
+ *        (HOST_UPDATE_PATH, default ./update.bin).
+ */
+
+#ifndef HOST_UPDATE
+#define HOST_UPDATE
+
+#include <Arduino.h>
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+#define UPDATE_ERROR_OK 0
+#define UPDATE_ERROR_WRITE 1
+#define UPDATE_ERROR_SIZE 4
+#define UPDATE_ERROR_STREAM 5
+
+class UpdateClass {
+    public:
+        bool begin(size_t size = UPDATE_SIZE_UNKNOWN);
+        size_t write(uint8_t* data, size_t len);
+        size_t writeStream(Stream& data);
+        bool end(bool evenIfRemaining = false);
+        bool isFinished() { return _finished; }
+        bool hasError() { return _error != UPDATE_ERROR_OK; }
+        uint8_t getError() { return _error; }
+        const char* errorString() { return _error == UPDATE_ERROR_OK ? "No Error" : "Update Error"; }
+        size_t size() { return _size; }
+        size_t progress() { return _progress; }
+        size_t remaining() { return _size - _progress; }
+
+    private:
+        FILE* _file = nullptr;
+        size_t _size = 0;
+        size_t _progress = 0;
+        uint8_t _error = UPDATE_ERROR_OK;
+        bool _finished = false;
+};
+
+extern UpdateClass Update;
+
+#endif // HOST_UPDATE
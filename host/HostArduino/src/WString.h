@@ -0,0 +1,68 @@
+/**
+ * @file WString.h
+ * @brief Host stand-in for the Arduino String class, backed by std::string.
+ */
+
+#ifndef HOST_WSTRING
+#define HOST_WSTRING
+
+#include <string>
+#include <cstdlib>
+#include <cstring>
+
+class String {
+    public:
+        String() {}
+        String(const char* s) : _s(s ? s : "") {}
+        String(const std::string& s) : _s(s) {}
+        String(char c) : _s(1, c) {}
+        String(int v) : _s(std::to_string(v)) {}
+        String(unsigned int v) : _s(std::to_string(v)) {}
+        String(long v) : _s(std::to_string(v)) {}
+        String(unsigned long v) : _s(std::to_string(v)) {}
+        String(long long v) : _s(std::to_string(v)) {}
+        String(unsigned long long v) : _s(std::to_string(v)) {}
+
+        unsigned int length() const { return _s.size(); }
+        const char* c_str() const { return _s.c_str(); }
+        bool isEmpty() const { return _s.empty(); }
+
+        String& operator+=(const String& o) { _s += o._s; return *this; }
+        String& operator+=(const char* o) { _s += o; return *this; }
+        String& operator+=(char c) { _s += c; return *this; }
+        friend String operator+(const String& a, const String& b) { return String(a._s + b._s); }
+        friend String operator+(const String& a, const char* b) { return String(a._s + b); }
+        friend String operator+(const char* a, const String& b) { return String(a + b._s); }
+        bool operator==(const String& o) const { return _s == o._s; }
+        bool operator==(const char* o) const { return _s == o; }
+        bool operator!=(const String& o) const { return _s != o._s; }
+        char operator[](unsigned int i) const { return i < _s.size() ? _s[i] : 0; }
+
+        int indexOf(char c, unsigned int from = 0) const { size_t p = _s.find(c, from); return p == std::string::npos ? -1 : (int)p; }
+        int indexOf(const String& s, unsigned int from = 0) const { size_t p = _s.find(s._s, from); return p == std::string::npos ? -1 : (int)p; }
+        int lastIndexOf(char c) const { size_t p = _s.rfind(c); return p == std::string::npos ? -1 : (int)p; }
+        String substring(unsigned int from) const { return from >= _s.size() ? String() : String(_s.substr(from)); }
+        String substring(unsigned int from, unsigned int to) const {
+            if (from > to) std::swap(from, to);
+            if (from >= _s.size()) return String();
+            return String(_s.substr(from, to - from));
+        }
+        bool startsWith(const String& p) const { return _s.compare(0, p._s.size(), p._s) == 0; }
+        bool endsWith(const String& p) const { return _s.size() >= p._s.size() && _s.compare(_s.size() - p._s.size(), p._s.size(), p._s) == 0; }
+        void replace(const String& from, const String& to) {
+            if (from._s.empty()) return;
+            size_t pos = 0;
+            while ((pos = _s.find(from._s, pos)) != std::string::npos) { _s.replace(pos, from._s.size(), to._s); pos += to._s.size(); }
+        }
+        long toInt() const { return std::strtol(_s.c_str(), nullptr, 10); }
+        void toCharArray(char* buf, unsigned int size) const {
+            if (!size) return;
+            size_t n = _s.size() < size - 1 ? _s.size() : size - 1;
+            std::memcpy(buf, _s.data(), n); buf[n] = 0;
+        }
+
+    private:
+        std::string _s;
+};
+
+#endif // HOST_WSTRING
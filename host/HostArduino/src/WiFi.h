@@ -0,0 +1,82 @@
+/**
+ * @file WiFi.h
+ * @brief Host stand-in for the ESP32 WiFi library: softAP is a no-op, WiFiServer/WiFiClient
+ *        are plain POSIX TCP sockets (HOST_HTTP_PORT overrides the listening port).
+ */
+
+#ifndef HOST_WIFI
+#define HOST_WIFI
+
+#include <Arduino.h>
+#include <memory>
+
+typedef enum { WL_IDLE_STATUS = 0, WL_NO_SSID_AVAIL, WL_SCAN_COMPLETED, WL_CONNECTED, WL_CONNECT_FAILED, WL_CONNECTION_LOST, WL_DISCONNECTED } wl_status_t;
+
+class IPAddress {
+    public:
+        IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) { _b[0] = a; _b[1] = b; _b[2] = c; _b[3] = d; }
+        String toString() const {
+            char buf[16];
+            snprintf(buf, sizeof(buf), "%u.%u.%u.%u", _b[0], _b[1], _b[2], _b[3]);
+            return String(buf);
+        }
+        uint8_t operator[](int i) const { return _b[i]; }
+
+    private:
+        uint8_t _b[4];
+};
+
+class WiFiClass {
+    public:
+        bool softAP(const char* ssid, const char* passphrase = nullptr) { (void)ssid; (void)passphrase; _apStarted = true; return true; }
+        IPAddress softAPIP() { return _apStarted ? IPAddress(127, 0, 0, 1) : IPAddress(); }
+        IPAddress localIP() { return IPAddress(); }
+        wl_status_t status() { return _apStarted ? WL_CONNECTED : WL_DISCONNECTED; }
+
+    private:
+        bool _apStarted = false;
+};
+
+extern WiFiClass WiFi;
+
+class WiFiClient : public Stream {
+    public:
+        WiFiClient() {}
+        explicit WiFiClient(int fd);
+
+        uint8_t connected();
+        int available() override;
+        int read() override;
+        int read(uint8_t* buf, size_t size);
+        size_t write(uint8_t c) override;
+        size_t write(const uint8_t* buf, size_t size) override;
+        void stop();
+        void setTimeout(uint32_t seconds);
+        int fd() const { return _sock ? _sock->fd : -1; }
+        operator bool() { return connected(); }
+        using Print::write;
+
+    private:
+        struct Socket {
+            explicit Socket(int f) : fd(f) {}
+            ~Socket();
+            int fd;
+        };
+        std::shared_ptr<Socket> _sock;
+        uint32_t _timeoutSeconds = 3;
+};
+
+class WiFiServer {
+    public:
+        explicit WiFiServer(uint16_t port = 80) : _port(port) {}
+        void begin(uint16_t port = 0);
+        WiFiClient available() { return accept(); }
+        WiFiClient accept();
+        void end();
+
+    private:
+        uint16_t _port;
+        int _fd = -1;
+};
+
+#endif // HOST_WIFI
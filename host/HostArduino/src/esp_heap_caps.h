@@ -0,0 +1,20 @@
+/**
+ * @file esp_heap_caps.h
+ * @brief Host stand-in for the ESP-IDF capability-based heap queries; there is no PSRAM.
+ */
+
+#ifndef HOST_ESP_HEAP_CAPS
+#define HOST_ESP_HEAP_CAPS
+
+#include <Arduino.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+inline size_t heap_caps_get_free_size(uint32_t caps) { return (caps & MALLOC_CAP_SPIRAM) ? 0 : ESP.getFreeHeap(); }
+inline size_t heap_caps_get_minimum_free_size(uint32_t caps) { return (caps & MALLOC_CAP_SPIRAM) ? 0 : ESP.getMinFreeHeap(); }
+inline size_t heap_caps_get_largest_free_block(uint32_t caps) { return (caps & MALLOC_CAP_SPIRAM) ? 0 : ESP.getMaxAllocHeap(); }
+inline size_t heap_caps_get_total_size(uint32_t caps) { return (caps & MALLOC_CAP_SPIRAM) ? 0 : ESP.getHeapSize(); }
+
+#endif // HOST_ESP_HEAP_CAPS
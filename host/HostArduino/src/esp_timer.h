@@ -0,0 +1,14 @@
+/**
+ * @file esp_timer.h
+ * @brief Host stand-in for the ESP-IDF high-resolution timer.
+ */
+
+#ifndef HOST_ESP_TIMER
+#define HOST_ESP_TIMER
+
+#include <cstdint>
+
+/** @brief Microseconds since the program started, from the host's monotonic clock. */
+int64_t esp_timer_get_time();
+
+#endif // HOST_ESP_TIMER
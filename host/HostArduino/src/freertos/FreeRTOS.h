@@ -0,0 +1,44 @@
+/**
+ * @file FreeRTOS.h
+ * @brief Host stand-in for the subset of FreeRTOS used by the libraries, built on std::thread.
+ */
+
+#ifndef HOST_FREERTOS
+#define HOST_FREERTOS
+
+#include <cstdint>
+#include <cstddef>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t StackType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define errQUEUE_FULL 0
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000U))
+#define tskNO_AFFINITY 0x7fffffff
+#define portNUM_PROCESSORS 2
+
+/** @brief Stand-in for the ESP-IDF spinlock; backed by one process-wide recursive mutex. */
+typedef struct { int unused; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+void hostEnterCritical(portMUX_TYPE* mux);
+void hostExitCritical(portMUX_TYPE* mux);
+#define portENTER_CRITICAL(mux) hostEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) hostExitCritical(mux)
+
+TickType_t xTaskGetTickCount();
+BaseType_t xPortGetCoreID();
+
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+
+#endif // HOST_FREERTOS
@@ -0,0 +1,21 @@
+/**
+ * @file event_groups.h
+ * @brief Host stand-in for FreeRTOS event groups.
+ */
+
+#ifndef HOST_FREERTOS_EVENT_GROUPS
+#define HOST_FREERTOS_EVENT_GROUPS
+
+#include "FreeRTOS.h"
+
+struct HostEventGroup;
+typedef HostEventGroup* EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+EventGroupHandle_t xEventGroupCreate();
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clearOnExit, BaseType_t waitForAll, TickType_t wait);
+
+#endif // HOST_FREERTOS_EVENT_GROUPS
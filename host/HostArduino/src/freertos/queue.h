@@ -0,0 +1,22 @@
+/**
+ * @file queue.h
+ * @brief Host stand-in for FreeRTOS queues: fixed-size items copied into a preallocated ring.
+ */
+
+#ifndef HOST_FREERTOS_QUEUE
+#define HOST_FREERTOS_QUEUE
+
+#include "FreeRTOS.h"
+
+struct HostQueue;
+typedef HostQueue* QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
+void vQueueDelete(QueueHandle_t queue);
+#define xQueueSendToBack xQueueSend
+
+#endif // HOST_FREERTOS_QUEUE
@@ -0,0 +1,6 @@
+/**
+ * @file queue.h
+ * @brief The ESP32 core puts the FreeRTOS headers on the include path, so <queue.h> works there too.
+ */
+
+#include "freertos/queue.h"
@@ -2,3 +2,19 @@
 #define MISO_PIN 2   // MISO pin
 #define MOSI_PIN 3   // MOSI pin
 #define CLK_PIN 18   // CLK pin (SCK pin)
+
+
+// SD card bus. STORAGE_BUS_SPI uses the pins above; the SDMMC modes use the pins below
+// (on the ESP32-S3 the SDMMC host can be routed to any GPIO).
+#define STORAGE_BUS_MODE STORAGE_BUS_SPI   // STORAGE_BUS_SPI, STORAGE_BUS_SDMMC_1BIT or STORAGE_BUS_SDMMC_4BIT
+#define STORAGE_FREQUENCY_KHZ 0            // Bus clock in kHz, 0 for the library default (4 MHz SPI, 20 MHz SDMMC);
+                                           // short wiring usually takes 20000 or more, see GET /storage/bench
+
+// SDMMC pins. Wired like the SPI card above, CLK/CMD/D0/D3 are SCK/MOSI/MISO/CS;
+// 4-bit mode also needs D1 and D2, -1 means not wired.
+#define SDMMC_CLK_PIN CLK_PIN
+#define SDMMC_CMD_PIN MOSI_PIN
+#define SDMMC_D0_PIN MISO_PIN
+#define SDMMC_D1_PIN -1
+#define SDMMC_D2_PIN -1
+#define SDMMC_D3_PIN CS_PIN
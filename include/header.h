@@ -10,9 +10,14 @@
 
 #include "config.h"
 
+#include "BootLib.h"
 #include "EssentialsLib.h"
+#include "GzipLib.h"
 #include "LoaderLib.h"
 #include "LoggerLib.h"
+#include "MetricsLib.h"
+#include "StorageLib.h"
+#include "TraceLib.h"
 #include "WebServerLib.h"
 
 #endif //HEADER
@@ -0,0 +1,121 @@
+/**
+ * @file BootLib.cpp
+ * @brief Implementation of the BootLib class.
+ */
+
+#include "BootLib.h"
+#include <TraceLib.h>
+
+static const char* LOG_TAG = "BOOT";
+
+BootLib::BootLib() {
+    _finished = xEventGroupCreate();
+}
+
+int BootLib::_add(const char* name, BootPhaseFunction function, void* context, EventBits_t dependsOn, uint32_t stackSize) {
+    EventBits_t earlier = ((EventBits_t)1 << _phaseCount) - 1;
+    if (_phaseCount >= BOOT_MAX_PHASES || function == nullptr || (dependsOn & ~earlier) != 0) {
+        return -1;
+    }
+
+    Phase &phase = _phases[_phaseCount];
+    phase.name = name;
+    phase.function = function;
+    phase.context = context;
+    phase.dependsOn = dependsOn;
+    phase.stackSize = stackSize;
+    phase.status = BOOT_PHASE_PENDING;
+    phase.owner = this;
+    return _phaseCount++;
+}
+
+EventBits_t BootLib::addPhase(const char* name, BootPhaseFunction function, void* context, EventBits_t dependsOn, uint32_t stackSize) {
+    int index = _add(name, function, context, dependsOn, stackSize);
+    return index < 0 ? 0 : (EventBits_t)1 << index;
+}
+
+EventBits_t BootLib::runInline(const char* name, BootPhaseFunction function, void* context) {
+    int index = _add(name, function, context, 0, 0);
+    if (index < 0) {
+        return 0;
+    }
+    _startedInline |= (EventBits_t)1 << index;
+    _runPhase(index);
+    return (EventBits_t)1 << index;
+}
+
+bool BootLib::run(TickType_t timeout) {
+    EventBits_t all = ((EventBits_t)1 << _phaseCount) - 1;
+    for (int i = 0; i < _phaseCount; i++) {
+        if (_startedInline & ((EventBits_t)1 << i)) continue;
+
+        // Phases that could not get a task run here instead, so that nothing waits on them forever
+        if (xTaskCreate(_phaseTask, _phases[i].name, _phases[i].stackSize, &_phases[i], BOOT_PHASE_PRIORITY, nullptr) != pdPASS) {
+            _runPhase(i);
+        }
+    }
+
+    EventBits_t finished = xEventGroupWaitBits(_finished, all, pdFALSE, pdTRUE, timeout);
+    if ((finished & all) != all) {
+        return false;
+    }
+    _readyTime = millis();
+
+    for (int i = 0; i < _phaseCount; i++) {
+        if (_phases[i].status != BOOT_PHASE_OK) return false;
+    }
+    return true;
+}
+
+void BootLib::_runPhase(int index) {
+    Phase &phase = _phases[index];
+    if (phase.dependsOn != 0) {
+        xEventGroupWaitBits(_finished, phase.dependsOn, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+
+    phase.startTime = millis();
+    phase.status = BOOT_PHASE_RUNNING;
+    bool ok;
+    {
+        TRACE_SCOPE(phase.name);
+        ok = phase.function(phase.context);
+    }
+    phase.endTime = millis();
+    phase.status = ok ? BOOT_PHASE_OK : BOOT_PHASE_FAILED;
+    xEventGroupSetBits(_finished, (EventBits_t)1 << index);
+}
+
+void BootLib::_phaseTask(void* parameter) {
+    Phase* phase = static_cast<Phase*>(parameter);
+    phase->owner->_runPhase(phase - phase->owner->_phases);
+    vTaskDelete(nullptr);
+}
+
+void BootLib::printReport(Print &out) const {
+    for (int i = 0; i < _phaseCount; i++) {
+        const Phase &phase = _phases[i];
+        bool finished = phase.status == BOOT_PHASE_OK || phase.status == BOOT_PHASE_FAILED;
+        out.printf("%s.status=%s\n", phase.name, statusName(phase.status));
+        out.printf("%s.start_ms=%lu\n", phase.name, (unsigned long)phase.startTime);
+        out.printf("%s.duration_ms=%lu\n", phase.name, finished ? (unsigned long)(phase.endTime - phase.startTime) : 0UL);
+    }
+    out.printf("ready_ms=%lu\n", (unsigned long)_readyTime);
+}
+
+void BootLib::logReport(LoggerLib* logger) const {
+    for (int i = 0; i < _phaseCount; i++) {
+        const Phase &phase = _phases[i];
+        LOG_I(logger, LOG_TAG, "%-8s %-7s started at %5lu ms, took %5lu ms", phase.name, statusName(phase.status),
+              (unsigned long)phase.startTime, (unsigned long)(phase.endTime - phase.startTime));
+    }
+    LOG_I(logger, LOG_TAG, "Boot finished %lu ms after reset", (unsigned long)_readyTime);
+}
+
+const char* BootLib::statusName(BootPhaseStatus status) {
+    switch (status) {
+        case BOOT_PHASE_RUNNING: return "running";
+        case BOOT_PHASE_OK: return "ok";
+        case BOOT_PHASE_FAILED: return "failed";
+        default: return "pending";
+    }
+}
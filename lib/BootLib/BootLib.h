@@ -0,0 +1,133 @@
+/**
+ * @file BootLib.h
+ * @brief Boot sequencing library: runs the boot phases as parallel tasks ordered by their
+ *        dependencies, and times each of them.
+ */
+
+#ifndef BOOT_LIB
+#define BOOT_LIB
+
+#include <Arduino.h>
+#include <freertos/event_groups.h>
+#include "LoggerLib.h"
+
+#define BOOT_MAX_PHASES 8          /**< Phases one BootLib can run */
+#define BOOT_PHASE_STACK_SIZE 4096 /**< Default stack of a phase task, in bytes */
+#define BOOT_PHASE_PRIORITY 1      /**< Priority of the phase tasks, the same as setup() */
+
+/**
+ * @brief State of a boot phase.
+ */
+enum BootPhaseStatus : uint8_t {
+    BOOT_PHASE_PENDING = 0, /**< Waiting for its dependencies */
+    BOOT_PHASE_RUNNING,     /**< Started, not finished */
+    BOOT_PHASE_OK,          /**< Finished successfully */
+    BOOT_PHASE_FAILED       /**< Finished, reported a failure */
+};
+
+/**
+ * @brief Body of a boot phase.
+ * @return False if the phase failed. Dependent phases still run; they decide for themselves
+ *         what a failed prerequisite means.
+ */
+typedef bool (*BootPhaseFunction)(void* context);
+
+/**
+ * @class BootLib
+ * @brief Runs boot phases in parallel FreeRTOS tasks. Each phase waits for the phases it
+ *        depends on through an event group, and its start and end times (milliseconds since
+ *        reset) are kept for the boot report.
+ */
+class BootLib {
+    public:
+        /**
+         * @brief Constructs an empty boot sequence.
+         */
+        BootLib();
+
+        /**
+         * @brief Adds a phase that run() starts in its own task.
+         * @param name Name of the phase in the report; must outlive the BootLib.
+         * @param function Body of the phase.
+         * @param context Passed to the function.
+         * @param dependsOn Phases (as returned by addPhase() or runInline()) to wait for; only
+         *        phases added earlier are allowed, so there can be no cycles.
+         * @param stackSize Stack of the phase task, in bytes.
+         * @return The phase's bit for use in dependsOn, or 0 if it could not be added.
+         */
+        EventBits_t addPhase(const char* name, BootPhaseFunction function, void* context = nullptr,
+                             EventBits_t dependsOn = 0, uint32_t stackSize = BOOT_PHASE_STACK_SIZE);
+
+        /**
+         * @brief Runs a phase right away in the calling task and records it like the others.
+         * @return The phase's bit, or 0 if it could not be added.
+         */
+        EventBits_t runInline(const char* name, BootPhaseFunction function, void* context = nullptr);
+
+        /**
+         * @brief Starts the added phases and waits for all of them to finish.
+         * @param timeout Ticks to wait.
+         * @return True if every phase finished and none failed.
+         */
+        bool run(TickType_t timeout = portMAX_DELAY);
+
+        /**
+         * @brief Milliseconds since reset at which run() saw the last phase finish, 0 before that.
+         */
+        uint32_t getReadyTime() const { return _readyTime; }
+
+        /**
+         * @brief Writes the start, duration and status of every phase as "name=value" lines.
+         */
+        void printReport(Print &out) const;
+
+        /**
+         * @brief Writes the boot report to the log, one line per phase, under the "BOOT" tag.
+         */
+        void logReport(LoggerLib* logger) const;
+
+        /**
+         * @brief Returns "pending", "running", "ok" or "failed".
+         */
+        static const char* statusName(BootPhaseStatus status);
+
+    private:
+        /**
+         * @brief A boot phase and its timing.
+         */
+        struct Phase {
+            const char* name;              /**< Name in the report */
+            BootPhaseFunction function;    /**< Body */
+            void* context;                 /**< Passed to the body */
+            EventBits_t dependsOn;         /**< Phases to wait for */
+            uint32_t stackSize;            /**< Stack of its task */
+            volatile BootPhaseStatus status; /**< Current state */
+            volatile uint32_t startTime;   /**< millis() when it started */
+            volatile uint32_t endTime;     /**< millis() when it finished */
+            BootLib* owner;                /**< BootLib it belongs to */
+        };
+
+        Phase _phases[BOOT_MAX_PHASES] = {}; /**< Phases in the order they were added */
+        uint8_t _phaseCount = 0;             /**< Phases added */
+        EventBits_t _startedInline = 0;      /**< Phases already run by runInline() */
+        EventGroupHandle_t _finished;        /**< One bit per finished phase */
+        uint32_t _readyTime = 0;             /**< See getReadyTime() */
+
+        /**
+         * @brief Adds a phase record.
+         * @return Its index, or -1.
+         */
+        int _add(const char* name, BootPhaseFunction function, void* context, EventBits_t dependsOn, uint32_t stackSize);
+
+        /**
+         * @brief Waits for the dependencies of a phase, runs it and marks it finished.
+         */
+        void _runPhase(int index);
+
+        /**
+         * @brief Task body of a phase started by run().
+         */
+        static void _phaseTask(void* parameter);
+};
+
+#endif // BOOT_LIB
@@ -1,25 +1,67 @@
 #include "EssentialsLib.h"
+#include <esp_timer.h>
 
 // Define the static member outside the class definition
 unsigned long EssentialsLib::startTime = 0;  // Initialize to 0
 
+// Heap allocation counters, only fed when the allocator is wrapped (see below)
+static volatile uint32_t heapAllocTotal = 0;
+static TaskHandle_t heapAllocTasks[ESSENTIALS_MAX_TRACKED_TASKS] = {};
+static volatile uint32_t heapAllocCounts[ESSENTIALS_MAX_TRACKED_TASKS] = {};
+
 EssentialsLib::EssentialsLib() {
     EssentialsLib::startTime = millis();
 }
 
 String EssentialsLib::getTimestamp() {
-    unsigned long elapsedTime = millis() - startTime;
+    char timeString[ESSENTIALS_TIMESTAMP_SIZE];
+    formatTimestamp(timeString, sizeof(timeString), getElapsedTime());
+
+    return String(timeString);
+}
 
+unsigned long EssentialsLib::getElapsedTime() {
+    return millis() - startTime;
+}
+
+int64_t EssentialsLib::getMicros() {
+    return esp_timer_get_time();
+}
+
+size_t EssentialsLib::formatTimestamp(char* buffer, size_t size, unsigned long elapsedTime) {
     unsigned long elapsedHours = elapsedTime / 3600000;
     unsigned long elapsedMinutes = (elapsedTime % 3600000) / 60000;
     unsigned long elapsedSeconds = (elapsedTime % 60000) / 1000;
     unsigned long elapsedMillis = elapsedTime % 1000;
 
     // Format the timestamp as HH:MM:SS:MS
-    char timeString[20];
-    sprintf(timeString, "%02lu:%02lu:%02lu:%02lu", elapsedHours, elapsedMinutes, elapsedSeconds, elapsedMillis);
+    int length = snprintf(buffer, size, "%02lu:%02lu:%02lu:%03lu", elapsedHours, elapsedMinutes, elapsedSeconds, elapsedMillis);
+    if (length < 0) {
+        buffer[0] = '\0';
+        return 0;
+    }
+    return ((size_t)length < size) ? (size_t)length : size - 1;
+}
 
-    return String(timeString);
+bool EssentialsLib::parseTimestamp(const char* text, unsigned long &elapsedTime) {
+    unsigned long fields[4];
+    int count = 0;
+    while (count < 4 && *text >= '0' && *text <= '9') {
+        char* end;
+        fields[count++] = strtoul(text, &end, 10);
+        text = end;
+        if (*text != ':') break;
+        text++;
+    }
+
+    switch (count) {
+        case 1: elapsedTime = fields[0]; break;                                                   // mmm
+        case 2: elapsedTime = (fields[0] * 60 + fields[1]) * 1000; break;                        // MM:SS
+        case 3: elapsedTime = ((fields[0] * 60 + fields[1]) * 60 + fields[2]) * 1000; break;     // HH:MM:SS
+        case 4: elapsedTime = ((fields[0] * 60 + fields[1]) * 60 + fields[2]) * 1000 + fields[3]; break;
+        default: return false;
+    }
+    return true;
 }
 
 unsigned long EssentialsLib::getUsedHeap() {
@@ -34,3 +76,90 @@ unsigned long EssentialsLib::getUsedHeap() {
 
     return usedHeap;
 }
+
+bool EssentialsLib::isHeapAllocCounterEnabled() {
+#ifdef ESSENTIALS_HEAP_ALLOC_COUNTER
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool EssentialsLib::trackHeapAllocations() {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < ESSENTIALS_MAX_TRACKED_TASKS; i++) {
+        if (heapAllocTasks[i] == self) {
+            return true;
+        }
+        if (heapAllocTasks[i] == nullptr) {
+            heapAllocCounts[i] = 0;
+            heapAllocTasks[i] = self;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t EssentialsLib::getHeapAllocCount(TaskHandle_t task) {
+    if (task == nullptr) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    for (int i = 0; i < ESSENTIALS_MAX_TRACKED_TASKS; i++) {
+        if (heapAllocTasks[i] == task) {
+            return heapAllocCounts[i];
+        }
+    }
+    return heapAllocTotal;
+}
+
+void EssentialsLib::printHeapAllocCounts(Print &out) {
+    out.print("heap_alloc_counter=");
+    out.println(isHeapAllocCounterEnabled() ? "enabled" : "disabled");
+    out.print("allocations.total=");
+    out.println((unsigned long)heapAllocTotal);
+    for (int i = 0; i < ESSENTIALS_MAX_TRACKED_TASKS && heapAllocTasks[i] != nullptr; i++) {
+        out.print("allocations.task.");
+        out.print(pcTaskGetName(heapAllocTasks[i]));
+        out.print("=");
+        out.println((unsigned long)heapAllocCounts[i]);
+    }
+}
+
+#ifdef ESSENTIALS_HEAP_ALLOC_COUNTER
+// Counts every allocation. Requires the linker to route the allocator through these wrappers:
+// -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc (set up by env:heapcheck).
+static void countHeapAlloc() {
+    __atomic_fetch_add(&heapAllocTotal, 1, __ATOMIC_RELAXED);
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    if (self == nullptr) {
+        return;
+    }
+    for (int i = 0; i < ESSENTIALS_MAX_TRACKED_TASKS; i++) {
+        if (heapAllocTasks[i] == self) {
+            heapAllocCounts[i] = heapAllocCounts[i] + 1; // Only ever written by the task itself
+            return;
+        }
+    }
+}
+
+extern "C" {
+    void* __real_malloc(size_t size);
+    void* __real_calloc(size_t count, size_t size);
+    void* __real_realloc(void* ptr, size_t size);
+
+    void* __wrap_malloc(size_t size) {
+        countHeapAlloc();
+        return __real_malloc(size);
+    }
+
+    void* __wrap_calloc(size_t count, size_t size) {
+        countHeapAlloc();
+        return __real_calloc(count, size);
+    }
+
+    void* __wrap_realloc(void* ptr, size_t size) {
+        if (size > 0) countHeapAlloc();
+        return __real_realloc(ptr, size);
+    }
+}
+#endif // ESSENTIALS_HEAP_ALLOC_COUNTER
@@ -3,14 +3,83 @@
 
 #include <Arduino.h>
 
+#define ESSENTIALS_TIMESTAMP_SIZE 20   // "HHH:MM:SS:mmm" plus terminator, with room to spare
+#define ESSENTIALS_MAX_TRACKED_TASKS 4 // Tasks that can have their own heap allocation counter
+
 class EssentialsLib{
     public:
         EssentialsLib();
         static String getTimestamp();
         static unsigned long getUsedHeap();
 
+        /**
+         * @brief Milliseconds since the program started.
+         */
+        static unsigned long getElapsedTime();
+
+        /**
+         * @brief Microseconds since boot from the 64-bit hardware timer. Monotonic and does not
+         *        wrap, unlike micros(), and is cheap enough to call around every traced span.
+         */
+        static int64_t getMicros();
+
+        /**
+         * @brief Formats an elapsed time as HH:MM:SS:mmm without touching the heap.
+         * @param buffer Destination buffer, ESSENTIALS_TIMESTAMP_SIZE bytes is always enough.
+         * @param size Size of the destination buffer.
+         * @param elapsedTime Time to format, as returned by getElapsedTime().
+         * @return Number of characters written, excluding the terminator.
+         */
+        static size_t formatTimestamp(char* buffer, size_t size, unsigned long elapsedTime);
+
+        /**
+         * @brief Parses a time written as HH:MM:SS:mmm (as formatTimestamp() writes it), HH:MM:SS,
+         *        MM:SS or plain milliseconds. Parsing stops at the first other character.
+         * @param text Text to parse.
+         * @param elapsedTime Receives the time in milliseconds.
+         * @return False if the text does not start with a time.
+         */
+        static bool parseTimestamp(const char* text, unsigned long &elapsedTime);
+
+        /**
+         * @brief Whether this build counts heap allocations (env:heapcheck, see platformio.ini).
+         */
+        static bool isHeapAllocCounterEnabled();
+
+        /**
+         * @brief Starts counting heap allocations made by the calling task separately.
+         * @return False if all tracking slots are in use.
+         */
+        static bool trackHeapAllocations();
+
+        /**
+         * @brief Number of malloc/calloc/realloc calls made by a task since it was tracked.
+         * @param task Task to query; nullptr for the calling task. Untracked tasks report the
+         *        count of all tasks together.
+         */
+        static uint32_t getHeapAllocCount(TaskHandle_t task = nullptr);
+
+        /**
+         * @brief Writes the total and per-task heap allocation counts as "name=value" lines.
+         */
+        static void printHeapAllocCounts(Print &out);
+
     private:
         static unsigned long startTime; // Record the time when the program started
 };
 
-#endif //ESSENTIALS_LIB
\ No newline at end of file
+/**
+ * @class HeapAllocProbe
+ * @brief Counts the heap allocations the calling task makes while the probe is alive.
+ *        Always reports 0 unless the heap allocation counter is compiled in.
+ */
+class HeapAllocProbe {
+    public:
+        HeapAllocProbe() : _start(EssentialsLib::getHeapAllocCount()) {}
+        uint32_t allocations() const { return EssentialsLib::getHeapAllocCount() - _start; }
+
+    private:
+        uint32_t _start;
+};
+
+#endif //ESSENTIALS_LIB
@@ -0,0 +1,242 @@
+/**
+ * @file GzipLib.cpp
+ * @brief Implementation of the GzipLib class (RFC 1951 deflate in an RFC 1952 gzip wrapper).
+ */
+
+#include "GzipLib.h"
+
+#if GZIP_WINDOW_BITS < 9 || GZIP_WINDOW_BITS > 14
+#error "GZIP_WINDOW_BITS must be 9..14: positions in the doubled window are kept in 16 bits"
+#endif
+
+#define GZIP_MIN_MATCH 3
+#define GZIP_MAX_MATCH 258
+#define GZIP_LOOKAHEAD (GZIP_MAX_MATCH + GZIP_MIN_MATCH + 1)  // Input kept ahead of _position unless flushing
+#define GZIP_MAX_DISTANCE (GZIP_WINDOW_SIZE - GZIP_LOOKAHEAD) // History that survives a slide
+
+// Length symbols 257..285 and distance codes 0..29: smallest value of each and its extra bits
+static const uint16_t lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t distanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t distanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Huffman codes are defined MSB first but packed LSB first, so they are written bit-reversed
+static uint32_t reverseBits(uint32_t value, int count) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < count; i++) {
+        reversed = (reversed << 1) | (value & 1);
+        value >>= 1;
+    }
+    return reversed;
+}
+
+void GzipLib::begin(Print &destination) {
+    _destination = &destination;
+    _failed = false;
+    _crc = 0;
+    _inputBytes = 0;
+    _outputBytes = 0;
+    _position = 0;
+    _end = 0;
+    memset(_head, 0, sizeof(_head));
+    _bits = 0;
+    _bitCount = 0;
+    _outputLength = 0;
+
+    // Magic, deflate, no flags, no mtime, no extra flags, unknown OS
+    static const uint8_t header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 255};
+    for (uint8_t value : header) _putByte(value);
+
+    // One fixed-Huffman block for the whole stream (BFINAL=0, BTYPE=01); finish() closes it
+    _putBits(0, 1);
+    _putBits(1, 2);
+}
+
+size_t GzipLib::write(const uint8_t* buffer, size_t size) {
+    if (_destination == nullptr) {
+        return 0;
+    }
+
+    _crc = _updateCrc(_crc, buffer, size);
+    _inputBytes += size;
+    size_t remaining = size;
+    while (remaining > 0) {
+        if (_end == sizeof(_window)) {
+            _slide();
+        }
+        size_t count = min(remaining, sizeof(_window) - _end);
+        memcpy(_window + _end, buffer, count);
+        _end += count;
+        buffer += count;
+        remaining -= count;
+        _compress(false);
+    }
+    return size;
+}
+
+bool GzipLib::finish() {
+    if (_destination == nullptr) {
+        return false;
+    }
+
+    _compress(true);
+    _putSymbol(256); // End of the block
+
+    // An empty final block marks the end of the deflate stream
+    _putBits(1, 1);
+    _putBits(1, 2);
+    _putSymbol(256);
+    if (_bitCount > 0) {
+        _putBits(0, 8 - _bitCount);
+    }
+
+    for (int i = 0; i < 4; i++) _putByte((uint8_t)(_crc >> (8 * i)));
+    for (int i = 0; i < 4; i++) _putByte((uint8_t)(_inputBytes >> (8 * i)));
+    _flushOutput();
+
+    _destination = nullptr;
+    return !_failed;
+}
+
+void GzipLib::_compress(bool flush) {
+    size_t keep = flush ? 0 : GZIP_LOOKAHEAD;
+    while (_end - _position > keep) {
+        size_t length = 0;
+        size_t distance = 0;
+        if (_end - _position >= GZIP_MIN_MATCH) {
+            length = _longestMatch(_position, _insert(_position), distance);
+        }
+
+        if (length == 0) {
+            _putLiteral(_window[_position]);
+            _position++;
+            continue;
+        }
+
+        _putMatch(length, distance);
+        // Index the rest of the match too, so later repeats of it can be found
+        for (size_t i = 1; i < length; i++) {
+            if (_position + i + GZIP_MIN_MATCH <= _end) _insert(_position + i);
+        }
+        _position += length;
+    }
+}
+
+void GzipLib::_slide() {
+    memmove(_window, _window + GZIP_WINDOW_SIZE, GZIP_WINDOW_SIZE);
+    _position -= GZIP_WINDOW_SIZE;
+    _end -= GZIP_WINDOW_SIZE;
+    for (int i = 0; i < GZIP_HASH_SIZE; i++) {
+        _head[i] = _head[i] > GZIP_WINDOW_SIZE ? _head[i] - GZIP_WINDOW_SIZE : 0;
+    }
+    for (int i = 0; i < GZIP_WINDOW_SIZE; i++) {
+        _prev[i] = _prev[i] > GZIP_WINDOW_SIZE ? _prev[i] - GZIP_WINDOW_SIZE : 0;
+    }
+}
+
+uint16_t GzipLib::_insert(size_t position) {
+    uint32_t key = ((uint32_t)_window[position] << 16) | ((uint32_t)_window[position + 1] << 8) | _window[position + 2];
+    uint32_t hash = (uint32_t)(key * 2654435761u) >> (32 - GZIP_HASH_BITS); // Fibonacci hashing
+    uint16_t previous = _head[hash];
+    _prev[position & (GZIP_WINDOW_SIZE - 1)] = previous;
+    _head[hash] = (uint16_t)(position + 1);
+    return previous;
+}
+
+size_t GzipLib::_longestMatch(size_t position, uint16_t candidate, size_t &distance) const {
+    size_t limit = min((size_t)GZIP_MAX_MATCH, _end - position);
+    size_t best = 0;
+    const uint8_t* current = _window + position;
+
+    for (int chain = 0; chain < GZIP_MAX_CHAIN && candidate != 0; chain++) {
+        size_t start = candidate - 1;
+        if (position - start > GZIP_MAX_DISTANCE) {
+            break; // Chains only get older
+        }
+
+        const uint8_t* earlier = _window + start;
+        if (earlier[best] == current[best]) { // Cheap reject of candidates that cannot beat the best
+            size_t length = 0;
+            while (length < limit && earlier[length] == current[length]) length++;
+            if (length > best) {
+                best = length;
+                distance = position - start;
+                if (best == limit) break;
+            }
+        }
+        candidate = _prev[start & (GZIP_WINDOW_SIZE - 1)];
+    }
+    return best >= GZIP_MIN_MATCH ? best : 0;
+}
+
+void GzipLib::_putLiteral(uint8_t value) {
+    _putSymbol(value);
+}
+
+void GzipLib::_putMatch(size_t length, size_t distance) {
+    int code = 28;
+    while (lengthBase[code] > length) code--;
+    _putSymbol(257 + code);
+    _putBits(length - lengthBase[code], lengthExtra[code]);
+
+    code = 29;
+    while (distanceBase[code] > distance) code--;
+    _putBits(reverseBits(code, 5), 5);
+    _putBits(distance - distanceBase[code], distanceExtra[code]);
+}
+
+void GzipLib::_putSymbol(unsigned symbol) {
+    // The fixed literal/length code of RFC 1951 section 3.2.6
+    if (symbol < 144) {
+        _putBits(reverseBits(0x30 + symbol, 8), 8);
+    } else if (symbol < 256) {
+        _putBits(reverseBits(0x190 + symbol - 144, 9), 9);
+    } else if (symbol < 280) {
+        _putBits(reverseBits(symbol - 256, 7), 7);
+    } else {
+        _putBits(reverseBits(0xC0 + symbol - 280, 8), 8);
+    }
+}
+
+void GzipLib::_putBits(uint32_t value, int count) {
+    _bits |= value << _bitCount;
+    _bitCount += count;
+    while (_bitCount >= 8) {
+        _putByte((uint8_t)_bits);
+        _bits >>= 8;
+        _bitCount -= 8;
+    }
+}
+
+void GzipLib::_putByte(uint8_t value) {
+    _output[_outputLength++] = value;
+    if (_outputLength == sizeof(_output)) {
+        _flushOutput();
+    }
+}
+
+void GzipLib::_flushOutput() {
+    if (_outputLength == 0) {
+        return;
+    }
+    if (!_failed && _destination->write(_output, _outputLength) != _outputLength) {
+        _failed = true; // Client gone; keep compressing to nowhere rather than stall the caller
+    }
+    _outputBytes += _outputLength;
+    _outputLength = 0;
+}
+
+uint32_t GzipLib::_updateCrc(uint32_t crc, const uint8_t* data, size_t size) {
+    // Four bits at a time: a 64-byte table instead of 1 KB
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+    };
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ table[crc & 0x0f];
+        crc = (crc >> 4) ^ table[crc & 0x0f];
+    }
+    return ~crc;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file GzipLib.h
+ * @brief Gzip library: streaming deflate compression with a fixed memory footprint, for
+ *        sending files to clients compressed without temporary files.
+ */
+
+#ifndef GZIP_LIB
+#define GZIP_LIB
+
+#include <Arduino.h>
+
+#ifndef GZIP_WINDOW_BITS
+#define GZIP_WINDOW_BITS 12  /**< History window of 4 KB; each step up doubles the window and _prev */
+#endif
+#ifndef GZIP_HASH_BITS
+#define GZIP_HASH_BITS 11    /**< 2048 hash chains */
+#endif
+#ifndef GZIP_MAX_CHAIN
+#define GZIP_MAX_CHAIN 32    /**< Candidates tried per position; lower is faster, higher compresses better */
+#endif
+#define GZIP_OUTPUT_SIZE 512 /**< Compressed bytes collected before they are written to the destination */
+
+#define GZIP_WINDOW_SIZE (1 << GZIP_WINDOW_BITS)
+#define GZIP_HASH_SIZE (1 << GZIP_HASH_BITS)
+
+/**
+ * @class GzipLib
+ * @brief Compresses everything written to it into a gzip stream on another Print. Uses LZ77
+ *        over a GZIP_WINDOW_SIZE window and the fixed Huffman codes of deflate, so all state
+ *        lives in the object (about 4 * GZIP_WINDOW_SIZE + 2 * GZIP_HASH_SIZE bytes) and
+ *        nothing is allocated. One object can compress any number of streams, one at a time.
+ */
+class GzipLib : public Print {
+    public:
+        /**
+         * @brief Starts a stream: writes the gzip header to the destination.
+         * @param destination Receives the compressed bytes, e.g. a WiFiClient.
+         */
+        void begin(Print &destination);
+
+        /**
+         * @brief Compresses bytes. Output reaches the destination in GZIP_OUTPUT_SIZE pieces.
+         */
+        size_t write(const uint8_t* buffer, size_t size) override;
+        size_t write(uint8_t c) override { return write(&c, 1); }
+        using Print::write;
+
+        /**
+         * @brief Compresses what is left, writes the gzip trailer and ends the stream.
+         * @return False if the destination did not take every byte.
+         */
+        bool finish();
+
+        /**
+         * @brief Bytes written to the stream so far.
+         */
+        uint32_t getInputBytes() const { return _inputBytes; }
+
+        /**
+         * @brief Compressed bytes handed to the destination so far, header and trailer included.
+         */
+        uint32_t getOutputBytes() const { return _outputBytes; }
+
+    private:
+        Print* _destination = nullptr;
+        bool _failed = false;                      /**< The destination refused bytes */
+        uint32_t _crc = 0;                         /**< CRC-32 of the input so far */
+        uint32_t _inputBytes = 0;
+        uint32_t _outputBytes = 0;
+
+        uint8_t _window[2 * GZIP_WINDOW_SIZE];     /**< History followed by input not compressed yet */
+        size_t _position = 0;                      /**< Next byte of _window to compress */
+        size_t _end = 0;                           /**< Bytes in _window */
+        uint16_t _head[GZIP_HASH_SIZE];            /**< Latest position + 1 of each hash, 0 for none */
+        uint16_t _prev[GZIP_WINDOW_SIZE];          /**< Previous position + 1 with the same hash */
+
+        uint32_t _bits = 0;                        /**< Bits not yet forming a whole byte, LSB first */
+        int _bitCount = 0;
+        uint8_t _output[GZIP_OUTPUT_SIZE];
+        size_t _outputLength = 0;
+
+        /**
+         * @brief Compresses the window up to the last GZIP lookahead, or all of it when flushing.
+         */
+        void _compress(bool flush);
+
+        /**
+         * @brief Drops the oldest half of the window to make room for input.
+         */
+        void _slide();
+
+        /**
+         * @brief Adds the three bytes at a position to the hash chains.
+         * @return Previous position + 1 with the same hash, 0 for none.
+         */
+        uint16_t _insert(size_t position);
+
+        /**
+         * @brief Longest earlier match of the bytes at a position.
+         * @param candidate First candidate position + 1, as returned by _insert().
+         * @param distance Receives how far back the match is.
+         * @return Match length, 0 if there is none of at least 3 bytes.
+         */
+        size_t _longestMatch(size_t position, uint16_t candidate, size_t &distance) const;
+
+        void _putLiteral(uint8_t value);
+        void _putMatch(size_t length, size_t distance);
+
+        /**
+         * @brief Writes a fixed Huffman literal/length symbol.
+         */
+        void _putSymbol(unsigned symbol);
+
+        /**
+         * @brief Appends bits LSB first, as deflate packs everything except Huffman codes.
+         */
+        void _putBits(uint32_t value, int count);
+
+        void _putByte(uint8_t value);
+        void _flushOutput();
+
+        /**
+         * @brief Continues a CRC-32 (the gzip polynomial) over more data.
+         */
+        static uint32_t _updateCrc(uint32_t crc, const uint8_t* data, size_t size);
+};
+
+#endif // GZIP_LIB
@@ -1,120 +1,109 @@
 #include "LoaderLib.h"
+#include <TraceLib.h>
 
-// Constructor to initialize SD card and logger
-LoaderLib::LoaderLib(int SD_CS, int SD_MISO, int SD_MOSI, int SD_SCK, LoggerLib* logger)
-: _SD_CS(SD_CS), _SD_MISO(SD_MISO), _SD_MOSI(SD_MOSI), _SD_SCK(SD_SCK), _logger(logger) {
-    _logger = logger; // Store logger reference
-
-    _logger->log("Initializing SD card...");
-    SPI.begin(SD_SCK, SD_MISO, SD_MOSI, SD_CS);
-    
-    if (!SD.begin(SD_CS)) {
-        _logger->log("Card Mount Failed");
-        return;
-    }
+static const char* LOG_TAG = "LOADER";
 
-    uint8_t cardType = SD.cardType();
-    if (cardType == CARD_NONE) {
-        _logger->log("No SD card attached");
-        return;
-    }
+#define FIRMWARE_STATS_MAGIC 0x46575550 // "FWUP"
+
+// Outcome of the last firmware update. RTC memory survives the restart that follows an update,
+// so the next firmware can still report it; `check` tells a real record from power-on garbage.
+struct FirmwareUpdateStats {
+    uint32_t magic;
+    uint32_t bytes;
+    uint32_t micros;
+    uint32_t succeeded;
+    uint32_t check;
+};
+static RTC_NOINIT_ATTR FirmwareUpdateStats lastFirmwareUpdate;
 
-    _logger->log("SD Card initialized");
+static uint32_t firmwareStatsCheck(const FirmwareUpdateStats &stats) {
+    return stats.magic ^ stats.bytes ^ stats.micros ^ stats.succeeded ^ 0xA5A5A5A5;
 }
 
-bool LoaderLib::begin() {
-    // Initialize SPI for SD card
-    SPI.begin(_SD_SCK, _SD_MISO, _SD_MOSI, _SD_CS);
+// Constructor to store the storage and logger; the card is mounted in begin()
+LoaderLib::LoaderLib(StorageLib* storage, LoggerLib* logger)
+: _storage(storage), _logger(logger) {
+}
 
-    _logger->log("Initializing SD card...");
-    
-    if (!SD.begin(_SD_CS)) {
-        _logger->log("Card Mount Failed");
-        return false;
-    }
+bool LoaderLib::begin() {
+    LOG_D(_logger, LOG_TAG, "Initializing SD card...");
 
-    uint8_t cardType = SD.cardType();
-    if (cardType == CARD_NONE) {
-        _logger->log("No SD card attached");
+    if (!_storage->begin()) {
+        LOG_E(_logger, LOG_TAG, "Card Mount Failed");
         return false;
     }
 
-    _logger->log("SD Card initialized successfully");
+    LOG_I(_logger, LOG_TAG, "SD Card initialized successfully");
     return true;
 }
 
 void LoaderLib::update(String fileName, void (*completion)(int status)) {
+    update(fileName.c_str(), completion);
+}
+
+void LoaderLib::update(const char* fileName, void (*completion)(int status)) {
     // Store the completion callback
     _completion = completion;
-    File firmware = SD.open("/" + fileName);
-
-    // Check if fileName ends with ".bin", if not, add it
-    if (!fileName.endsWith(".bin") && !fileName.endsWith(".bin/")) {
-        String tempFileName = fileName + ".bin";
-        // Attempt to open the firmware file with the current fileName
-        firmware = SD.open("/" + tempFileName);
-        _logger->log("Verifying update file " + tempFileName);
-        if (firmware) {fileName = tempFileName;} 
+    char path[LOADER_PATH_SIZE];
+
+    // Try the name as given, then with ".bin" appended, then as a program folder holding firmware.bin
+    bool found = _buildPath(path, sizeof(path), fileName, "") && _isFile(path);
+    if (!found && !_endsWith(path, ".bin") && !_endsWith(path, ".bin/")) {
+        found = _buildPath(path, sizeof(path), fileName, ".bin") && _isFile(path);
+        LOG_D(_logger, LOG_TAG, "Verifying update file %s", path);
     }
 
-    if (!firmware) {
+    if (!found) {
         // If the file doesn't exist, attempt "/firmware.bin"
-        String tempFileName = fileName + "/firmware.bin";
-        _logger->log("File doesn't exist, trying to search for " + tempFileName);
-        firmware = SD.open(tempFileName);
+        found = _buildPath(path, sizeof(path), fileName, "/firmware.bin") && _isFile(path);
+        LOG_D(_logger, LOG_TAG, "File doesn't exist, trying to search for %s", path);
 
-        if (!firmware) {
+        if (!found) {
             // If still doesn't exist, log the error and call the completion callback with a status of 0
-            _logger->log("Firmware file not found");
+            LOG_E(_logger, LOG_TAG, "Firmware file not found");
             if (_completion) _completion(0);
             return;  // Exit if no file is found
-        }else{
-            fileName = tempFileName;
         }
     }
 
     // File is found
-    _logger->log("Found firmware: " + fileName);
-    _updateFromFS(SD, fileName);
-
-    // Close the firmware file after use
-    firmware.close();
+    LOG_I(_logger, LOG_TAG, "Found firmware: %s", path);
+    _updateFromFS(_storage->fs(), path);
 }
 
-#include <list>
-#include <FS.h> // Include the FS library if not already included
-
-std::list<String> LoaderLib::listAllPrograms() {
-    std::list<String> programs; // List to store program paths
+size_t LoaderLib::forEachProgram(void (*callback)(const char* programName, void* context), void* context) {
+    size_t count = 0;
+    StorageLock lock(_storage);
 
     // Open the /Programs directory
-    File dir = SD.open("/Programs");
+    File dir = _storage->fs().open("/Programs");
     if (!dir) {
-        _logger->log("Failed to open /Programs directory");
-        return programs; // Return empty list if the directory can't be opened
+        LOG_E(_logger, LOG_TAG, "Failed to open /Programs directory");
+        return count; // Nothing to report if the directory can't be opened
     }
 
     // Check if the opened file is a directory
     if (!dir.isDirectory()) {
-        _logger->log("/Programs is not a directory");
-        return programs; // Return empty list if it isn't a directory
+        LOG_E(_logger, LOG_TAG, "/Programs is not a directory");
+        return count; // Nothing to report if it isn't a directory
     }
 
     // Iterate through the entries in the /Programs directory
+    char path[LOADER_PATH_SIZE];
     File entry = dir.openNextFile();
     while (entry) {
         if (entry.isDirectory()) {
-            String programName = entry.name(); // Get the name of the directory
-
-            // Check for index.html file in the current directory
-            File indexFile = SD.open("/Programs/" + programName + "/firmware.bin");
-            if (indexFile) {
-                // If index.html exists, add the program path to the list
-                programs.push_back(programName);
-                _logger->log("Found program: " + programName);
-                indexFile.close(); // Close index.html after checking
+            const char* programName = entry.name(); // Get the name of the directory
+
+            // Check for firmware.bin file in the current directory
+            snprintf(path, sizeof(path), "/Programs/%s/firmware.bin", programName);
+            if (_storage->fs().exists(path)) {
+                // If firmware.bin exists, report the program
+                LOG_D(_logger, LOG_TAG, "Found program: %s", programName);
+                callback(programName, context);
+                count++;
             } else {
-                _logger->log("firmware.bin not found in " + programName);
+                LOG_W(_logger, LOG_TAG, "firmware.bin not found in %s", programName);
             }
         }
         entry.close(); // Close the current entry before moving to the next
@@ -122,63 +111,130 @@ std::list<String> LoaderLib::listAllPrograms() {
     }
 
     dir.close(); // Close the /Programs directory after finishing
+    return count;
+}
+
+std::list<String> LoaderLib::listAllPrograms() {
+    std::list<String> programs; // List to store program paths
+    forEachProgram([](const char* programName, void* context) {
+        static_cast<std::list<String>*>(context)->push_back(programName);
+    }, &programs);
     return programs; // Return the list of program directories
 }
 
 // Other methods remain unchanged, just replace Serial prints with logger
-void LoaderLib::_updateFromFS(fs::FS &fs, String fileName) {
-    File updateBin = fs.open("/" + fileName);
+void LoaderLib::_updateFromFS(fs::FS &fs, const char* path) {
+    _storage->lock(STORAGE_IO_FIRMWARE); // Held while the image streams; released before the reboot so the log can be flushed
+    File updateBin = fs.open(path);
     if (updateBin) {
         if (updateBin.isDirectory()) {
-            _logger->log("Error, " + fileName + " is not a file");
+            LOG_E(_logger, LOG_TAG, "Error, %s is not a file", path);
             updateBin.close();
+            _storage->unlock();
             return;
         }
 
         size_t updateSize = updateBin.size();
         if (updateSize > 0) {
-            _logger->log("Trying to start update");
+            LOG_I(_logger, LOG_TAG, "Trying to start update");
             _performUpdate(updateBin, updateSize);
         } else {
-            _logger->log("Error, file is empty");
+            LOG_E(_logger, LOG_TAG, "Error, file is empty");
         }
 
         updateBin.close();
+        _storage->unlock();
         _rebootEspWithReason("finished update");
     } else {
-        _logger->log("Could not load " + fileName + " from sd root");
+        _storage->unlock();
+        LOG_E(_logger, LOG_TAG, "Could not load %s from sd root", path);
     }
 }
 
 void LoaderLib::_performUpdate(Stream &updateSource, size_t updateSize) {
+    TRACE_SCOPE("firmware.update");
     if (Update.begin(updateSize)) {      
+        uint32_t start = micros();
         size_t written = Update.writeStream(updateSource);
+        uint32_t elapsed = micros() - start;
+        _storage->recordReadBytes(written); // The duration, flash erase and write included, is in firmware_update_*
+
+        lastFirmwareUpdate.magic = FIRMWARE_STATS_MAGIC;
+        lastFirmwareUpdate.bytes = written;
+        lastFirmwareUpdate.micros = elapsed;
+        lastFirmwareUpdate.succeeded = written == updateSize;
+        lastFirmwareUpdate.check = firmwareStatsCheck(lastFirmwareUpdate);
+
         if (written == updateSize) {
-            _logger->log("Written : " + String(written) + " successfully");
+            LOG_I(_logger, LOG_TAG, "Written : %u successfully in %lu ms", (unsigned)written, (unsigned long)(elapsed / 1000));
         } else {
-            _logger->log("Written only : " + String(written) + "/" + String(updateSize) + ". Retry?");
+            LOG_E(_logger, LOG_TAG, "Written only : %u/%u. Retry?", (unsigned)written, (unsigned)updateSize);
             if (_completion) _completion(0);
         } 
         if (Update.end()) {
-            _logger->log("OTA done!");
+            LOG_I(_logger, LOG_TAG, "OTA done!");
             if (Update.isFinished()) {
-                _logger->log("Update successfully completed. Rebooting.");
+                LOG_I(_logger, LOG_TAG, "Update successfully completed. Rebooting.");
             } else {
-                _logger->log("Update not finished? Something went wrong!");
+                LOG_E(_logger, LOG_TAG, "Update not finished? Something went wrong!");
                 if (_completion) _completion(0);
             }
         } else {
-            _logger->log("Error Occurred. Error #: " + String(Update.getError()));
+            LOG_E(_logger, LOG_TAG, "Error Occurred. Error #: %u", (unsigned)Update.getError());
             if (_completion) _completion(0);
         }
     } else {
-        _logger->log("Not enough space to begin OTA");
+        LOG_E(_logger, LOG_TAG, "Not enough space to begin OTA");
         if (_completion) _completion(0);
     }
 }
 
-void LoaderLib::_rebootEspWithReason(String reason) {
-    _logger->log(reason);
+void LoaderLib::printMetrics(Print &out) const {
+    const FirmwareUpdateStats &stats = lastFirmwareUpdate;
+    if (stats.magic != FIRMWARE_STATS_MAGIC || stats.check != firmwareStatsCheck(stats)) {
+        return; // No update since power-on
+    }
+
+    MetricsLib::printValue(out, "firmware_update_bytes", "gauge", "Size of the image streamed by the last firmware update.", stats.bytes);
+    MetricsLib::printHeader(out, "firmware_update_duration_seconds", "gauge", "Time the last firmware update took to stream its image.");
+    out.printf(METRICS_PREFIX "firmware_update_duration_seconds %lu.%06lu\n", (unsigned long)(stats.micros / 1000000), (unsigned long)(stats.micros % 1000000));
+    uint64_t throughput = stats.micros ? (uint64_t)stats.bytes * 1000000 / stats.micros : 0;
+    MetricsLib::printValue(out, "firmware_update_bytes_per_second", "gauge", "Streaming throughput of the last firmware update.", throughput);
+    MetricsLib::printValue(out, "firmware_update_success", "gauge", "1 if the last firmware update wrote the whole image.", stats.succeeded);
+}
+
+void LoaderLib::_rebootEspWithReason(const char* reason) {
+    LOG_I(_logger, LOG_TAG, "%s", reason);
     delay(1000);
     ESP.restart();
-}
\ No newline at end of file
+}
+
+bool LoaderLib::_buildPath(char* path, size_t size, const char* fileName, const char* suffix) {
+    // Exactly one leading slash, whatever the caller passed
+    while (*fileName == '/') fileName++;
+    size_t nameLength = strlen(fileName);
+    if (*suffix == '/') {
+        while (nameLength > 0 && fileName[nameLength - 1] == '/') nameLength--;
+    }
+
+    int length = snprintf(path, size, "/%.*s%s", (int)nameLength, fileName, suffix);
+    if (length < 0 || (size_t)length >= size) {
+        LOG_E(_logger, LOG_TAG, "Path too long: %s", fileName);
+        return false;
+    }
+    return true;
+}
+
+bool LoaderLib::_isFile(const char* path) {
+    StorageLock lock(_storage);
+    File file = _storage->fs().open(path);
+    bool isFile = file && !file.isDirectory();
+    file.close();
+    return isFile;
+}
+
+bool LoaderLib::_endsWith(const char* text, const char* suffix) {
+    size_t textLength = strlen(text);
+    size_t suffixLength = strlen(suffix);
+    return textLength >= suffixLength && strcmp(text + textLength - suffixLength, suffix) == 0;
+}
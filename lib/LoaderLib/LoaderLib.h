@@ -3,11 +3,12 @@
 
 #include <Arduino.h>
 #include <FS.h>
-#include <SPI.h>
-#include <SD.h>
 #include <Update.h>
 #include <list>
 #include "LoggerLib.h" // Include the LoggerLib
+#include "StorageLib.h"
+
+#define LOADER_PATH_SIZE 128 ///< Longest SD card path the loader builds
 
 /**
  * @class LoaderLib
@@ -16,18 +17,15 @@
 class LoaderLib {
     public:
         /**
-         * @brief Constructs a LoaderLib instance and initializes SD card pins and a logger.
-         * @param SD_CS Chip select pin for the SD card. Default is 5.
-         * @param SD_MISO MISO pin for the SD card. Default is 2.
-         * @param SD_MOSI MOSI pin for the SD card. Default is 19.
-         * @param SD_SCK Clock pin for the SD card. Default is 18.
+         * @brief Constructs a LoaderLib instance. Does not touch the SD card until begin().
+         * @param storage Storage that owns the SD card.
          * @param logger Pointer to a LoggerLib instance for logging. Default is nullptr.
          */
-        LoaderLib(int SD_CS = 5, int SD_MISO = 2, int SD_MOSI = 19, int SD_SCK = 18, LoggerLib* logger = nullptr);
+        LoaderLib(StorageLib* storage, LoggerLib* logger = nullptr);
 
         /**
-         * @brief Initializes the SD card and prepares it for file operations.
-         * @return true if the SD card was successfully initialized; false otherwise.
+         * @brief Makes sure the SD card is mounted; mounts it if nothing has yet.
+         * @return true if the SD card is mounted; false otherwise.
          */
         bool begin(); 
 
@@ -39,20 +37,45 @@ class LoaderLib {
          */
         void update(String fileName, void (*completion)(int status) = nullptr);
 
+        /**
+         * @brief Same as update(String, ...), but builds every candidate path in a fixed buffer.
+         * @param fileName Name of the firmware file, or of a program folder containing firmware.bin.
+         * @param completion Optional callback function to report the status of the update.
+         */
+        void update(const char* fileName, void (*completion)(int status) = nullptr);
+
+        /**
+         * @brief Lists the folders in /Programs that contain a firmware.bin.
+         * @return The program folder names.
+         */
         std::list<String> listAllPrograms();
 
+        /**
+         * @brief Calls a function for every folder in /Programs that contains a firmware.bin,
+         *        without building a list.
+         * @param callback Receives the program folder name and the context pointer.
+         * @param context Passed through to the callback.
+         * @return Number of programs found.
+         */
+        size_t forEachProgram(void (*callback)(const char* programName, void* context), void* context);
+
+        /**
+         * @brief Writes the size, duration and throughput of the last firmware update in the
+         *        Prometheus text format. The figures survive the restart after the update.
+         */
+        void printMetrics(Print &out) const;
+
     private:
         void (*_completion)(int status) = nullptr; ///< Completion callback
 
-        void _updateFromFS(fs::FS &fs, String fileName); ///< Internal method to perform update from filesystem
-        void _rebootEspWithReason(String reason); ///< Internal method to reboot ESP32 with a log reason
+        void _updateFromFS(fs::FS &fs, const char* path); ///< Internal method to perform update from filesystem
+        void _rebootEspWithReason(const char* reason); ///< Internal method to reboot ESP32 with a log reason
         void _performUpdate(Stream &updateSource, size_t updateSize); ///< Internal method to handle the update stream
+        bool _buildPath(char* path, size_t size, const char* fileName, const char* suffix); ///< Builds "/" + fileName + suffix; false if it does not fit
+        bool _isFile(const char* path); ///< True if path exists on the SD card and is not a directory
+        static bool _endsWith(const char* text, const char* suffix); ///< C string counterpart of String::endsWith
 
-        int _SD_CS; ///< SD card chip select pin
-        int _SD_MISO; ///< SD card MISO pin
-        int _SD_MOSI; ///< SD card MOSI pin
-        int _SD_SCK; ///< SD card clock pin
-        
+        StorageLib* _storage; ///< Storage that owns the SD card
         LoggerLib* _logger; ///< Pointer to LoggerLib instance for logging
 };
 
@@ -1,262 +1,891 @@
 #include "LoggerLib.h"
 #include <EssentialsLib.h>
-#include <vector>
+#include <MetricsLib.h>
+#include <TraceLib.h>
+#include <stdarg.h>
 
-#define LOG_MESSAGE_SIZE 1024
-#define LOG_MESSAGE_SIZE_HTML 1024
-#define MAX_LOG_DISPLAY_SIZE_HTML 4096 
+#define LOG_QUEUE_LENGTH 100
 #define MAX_LOG_MESSAGES 100 
 #define LATEST_LOG "/log/latest.log" 
-
-// Add this member to the LoggerLib class
-QueueHandle_t logQueue;
-
-String logMessages[MAX_LOG_MESSAGES];
+#define ARCHIVE_DIR "/Old logs"
+#define LOG_INDEX_RECORD_SIZE 8 // uint32 time, uint32 byte offset
+#define ROTATION_STATE_FILE "/log/rotation.state" // "next=N oldest=M": numbering of the archives in ARCHIVE_DIR
+#define HTML_COPY_CHUNK_SIZE 256
+#define LOGGER_COALESCE_FLUSH_MS 2000 // Repeats are reported once a line has not recurred for this long
+#define LOGGER_STATS_INTERVAL_MS 10000 // Minimum time between two "Dropped N lines" reports
+#define LOGGER_BATCH_POLL_MS 20 // How often a held-back batch checks whether the card is free again
+
+#if LOGGER_BATCH_LINES > MAX_LOG_MESSAGES
+#error "LOGGER_BATCH_LINES must not exceed the ring size, pending lines are written from the ring"
+#endif
+
+static const char* LOG_TAG = "LOGGER";
+
+// Formatted lines of the most recent messages, kept in static storage so the ring never allocates
+static char logMessages[MAX_LOG_MESSAGES][LOG_LINE_SIZE];
+static uint16_t logLengths[MAX_LOG_MESSAGES];
+static unsigned long logTimes[MAX_LOG_MESSAGES];
+static portMUX_TYPE _rateLimitMux = portMUX_INITIALIZER_UNLOCKED; // Guards the call-site buckets
 int logIndex = 0;  // Points to the current position in the circular buffer
 bool bufferFull = false;  // Indicates if the buffer has wrapped around
 
-// Constructor to set the SD card pins and log file name
-LoggerLib::LoggerLib(int SD_CS, int SD_MISO, int SD_MOSI, int SD_SCK, String logFileName) {
-    _SD_CS = SD_CS;
-    _SD_MISO = SD_MISO;
-    _SD_MOSI = SD_MOSI;
-    _SD_SCK = SD_SCK;
-    _logFileName = "/log/"+logFileName;
+// Constructor to set the storage and log file name
+LoggerLib::LoggerLib(StorageLib* storage, String logFileName) {
+    _storage = storage;
+    snprintf(_logFileName, sizeof(_logFileName), "/log/%s", logFileName.c_str());
 
     // Create a queue for logging messages
-    logQueue = xQueueCreate(100, LOG_MESSAGE_SIZE); // Queue for storing log messages
+    logQueue = xQueueCreate(LOG_QUEUE_LENGTH, sizeof(LogEntry)); // Queue for storing log messages
 }
 
 // Begin method to initialize Serial and SD card
 void LoggerLib::begin(long baudRate) {
+    beginSerial(baudRate);
+    beginLogFiles();
+}
+
+void LoggerLib::beginSerial(long baudRate) {
     // Start Serial communication
     Serial.begin(baudRate);
-    while (!Serial) {
-        // Wait for Serial to be ready (on boards that need it)
+
+#if LOGGER_SERIAL_WAIT_MS > 0
+    // Wait for Serial to be ready on boards that need it, but never hold up the boot for long
+    unsigned long start = millis();
+    while (!Serial && millis() - start < LOGGER_SERIAL_WAIT_MS) {
+        delay(1);
     }
+#endif
 
     // Print a message indicating Serial is ready
-    Serial.println("Logger started. Initializing SD card...");
+    Serial.println("Logger started.");
+}
+
+bool LoggerLib::beginLogFiles() {
+    Serial.println("Initializing SD card...");
 
     // Initialize SD card
     if (!_initializeSD()) {
         Serial.println("Failed to initialize SD card.");
-    } else {
-        Serial.println("SD card initialized.");
+        return false;
     }
+    Serial.println("SD card initialized.");
+    return true;
 }
 
-void LoggerLib::taskLog(SemaphoreHandle_t &logFileMutex, SemaphoreHandle_t &latestLogFileMutex, void *pvParameters) {
-    char message[LOG_MESSAGE_SIZE];
+void LoggerLib::taskLog(void*) {
+    LogEntry entry;
+
+    EssentialsLib::trackHeapAllocations();
+    MetricsLib::registerTask("logger");
     while (true) {
-        if (xQueueReceive(logQueue, &message, portMAX_DELAY) == pdTRUE) {
-            String logMessage = String(message);  // Convert the received message back to String
-            
-            // Write log to Serial and SD card
-            _writeToSerial(logMessage);
-            _writeToSD(logMessage, logFileMutex);
-
-            // Store the log message in the circular buffer
-            logMessages[logIndex] = logMessage;
-            logIndex = (logIndex + 1) % MAX_LOG_MESSAGES;  // Update the circular buffer index
-            
-            // Optional: Check if the buffer has wrapped around
-            if (logIndex == 0) {
-                bufferFull = true;
+        // Wake up now and then even when idle, so pending repeats and drop reports get written,
+        // and often while a batch is held back, to write it as soon as the card is free
+        TickType_t timeout = pdMS_TO_TICKS(_pendingLines > 0 ? LOGGER_BATCH_POLL_MS : LOGGER_COALESCE_FLUSH_MS);
+        bool received = xQueueReceive(logQueue, &entry, timeout) == pdTRUE;
+        uint32_t busyStart = micros();
+        if (received) {
+            HeapAllocProbe probe;
+
+            // Identical consecutive lines are only counted; the count is written once they stop
+            if (_repeatCount < UINT32_MAX && entry.level == _previous.level && strcmp(entry.tag, _previous.tag) == 0 && strcmp(entry.text, _previous.text) == 0) {
+                _repeatCount++;
+                _repeatTime = entry.time;
+                __atomic_fetch_add(&_stats.coalesced, 1, __ATOMIC_RELAXED);
+            } else {
+                _flushRepeats();
+                _writeEntry(entry);
+                memcpy(&_previous, &entry, sizeof(entry));
             }
+            _lastLineAllocations = probe.allocations();
+        }
+
+        if (_repeatCount > 0 && EssentialsLib::getElapsedTime() - _repeatTime >= LOGGER_COALESCE_FLUSH_MS) {
+            _flushRepeats();
+        }
+        _reportDrops();
 
-            // Write the circular buffer (latest log) to a separate file
-            _writeLatestLogToSD(latestLogFileMutex);
+        // Keep draining a burst into one batch; write once the queue is empty
+        if (uxQueueMessagesWaiting(logQueue) == 0 || _pendingLines >= LOGGER_BATCH_LINES) {
+            _writePendingToSD(false);
         }
+        MetricsLib::addTaskBusyTime(micros() - busyStart);
     }
 }
 
+void LoggerLib::_writeEntry(const LogEntry &entry) {
+    char line[LOG_LINE_SIZE];
+    size_t length = _formatLine(entry, line);
+
+    // Write log to Serial now; the SD card gets it with the next batch
+    _writeToSerial(line, length);
+
+    // A full batch is written before the ring slot of its oldest line is reused
+    if (_pendingLines >= LOGGER_BATCH_LINES) {
+        _writePendingToSD(true);
+    }
+
+    // Store the log line in the circular buffer
+    memcpy(logMessages[logIndex], line, length + 1);
+    logLengths[logIndex] = length;
+    logTimes[logIndex] = entry.time;
+    logIndex = (logIndex + 1) % MAX_LOG_MESSAGES;  // Update the circular buffer index
+    
+    // Optional: Check if the buffer has wrapped around
+    if (logIndex == 0) {
+        bufferFull = true;
+    }
+
+    if (_pendingLines++ == 0) {
+        _pendingSince = millis();
+    }
+    __atomic_fetch_add(&_stats.written, 1, __ATOMIC_RELAXED);
+}
+
+void LoggerLib::_writePendingToSD(bool force) {
+    if (_pendingLines == 0) {
+        return;
+    }
+
+    // Background class: let firmware streaming and page serving finish first, within limits
+    bool due = force || _pendingLines >= LOGGER_BATCH_LINES || millis() - _pendingSince >= LOGGER_BATCH_MAX_DELAY_MS;
+    if (!due && _storage->hasPriorityTraffic(STORAGE_IO_BACKGROUND)) {
+        if (!_deferring) {
+            _deferring = true;
+            __atomic_fetch_add(&_stats.deferred, 1, __ATOMIC_RELAXED);
+        }
+        return;
+    }
+
+    TRACE_SCOPE("log.batch");
+    StorageLock lock(_storage, STORAGE_IO_BACKGROUND);
+    uint32_t start = micros();
+    size_t bytes = 0;
+    for (uint16_t i = _pendingLines; i > 0; i--) {
+        int idx = (logIndex + MAX_LOG_MESSAGES - i) % MAX_LOG_MESSAGES;
+        _writeToSD(logMessages[idx], logLengths[idx], logTimes[idx]);
+        bytes += logLengths[idx] + 2;
+    }
+    if (_logFile) {
+        _logFile.flush();
+        _storage->recordWrite(bytes, micros() - start);
+    }
+    _pendingLines = 0;
+    _deferring = false;
+
+    // Write the circular buffer (latest log) to a separate file
+    start = micros();
+    bytes = _writeLatestLogToSD();
+    if (bytes > 0) {
+        _storage->recordWrite(bytes, micros() - start);
+    }
+    __atomic_fetch_add(&_stats.batches, 1, __ATOMIC_RELAXED);
+}
+
+void LoggerLib::_flushRepeats() {
+    if (_repeatCount == 0) {
+        return;
+    }
+
+    LogEntry summary;
+    summary.time = _repeatTime;
+    summary.level = _previous.level;
+    memcpy(summary.tag, _previous.tag, sizeof(summary.tag));
+    snprintf(summary.text, sizeof(summary.text), "Last message repeated %lu times", (unsigned long)_repeatCount);
+    _repeatCount = 0;
+    _writeEntry(summary);
+}
+
+void LoggerLib::_reportDrops() {
+    unsigned long now = EssentialsLib::getElapsedTime();
+    if (now - _lastStatsReport < LOGGER_STATS_INTERVAL_MS) {
+        return;
+    }
+
+    LoggerStats stats = getStats();
+    uint32_t rateLimited = stats.rateLimited - _reportedStats.rateLimited;
+    uint32_t queueFull = stats.queueFull - _reportedStats.queueFull;
+    if (rateLimited == 0 && queueFull == 0) {
+        return;
+    }
+
+    LogEntry report;
+    report.time = now;
+    report.level = LOGGER_LEVEL_WARN;
+    snprintf(report.tag, sizeof(report.tag), "%s", LOG_TAG);
+    snprintf(report.text, sizeof(report.text), "Dropped %lu lines over the rate limit and %lu on a full queue in the last %lus",
+             (unsigned long)rateLimited, (unsigned long)queueFull, (now - _lastStatsReport) / 1000);
+    _reportedStats = stats;
+    _lastStatsReport = now;
+    _writeEntry(report);
+    memcpy(&_previous, &report, sizeof(report));
+}
+
+bool LoggerLib::allow(LogRateLimit &limit) {
+    uint32_t now = millis();
+    bool allowed = false;
+
+    portENTER_CRITICAL(&_rateLimitMux);
+    if (!limit.primed) {
+        limit.tokens = LOGGER_RATE_LIMIT_BURST * 1000;
+        limit.lastRefill = now;
+        limit.primed = true;
+    }
+
+    // One token is 1000 units, refilled at LOGGER_RATE_LIMIT_PER_SECOND tokens per second, i.e. that many units per ms.
+    // The gap is capped at the time a full refill takes, so a site quiet for weeks cannot overflow the product
+    uint32_t elapsed = min(now - limit.lastRefill, (uint32_t)((LOGGER_RATE_LIMIT_BURST * 1000 + LOGGER_RATE_LIMIT_PER_SECOND - 1) / LOGGER_RATE_LIMIT_PER_SECOND));
+    uint32_t refill = elapsed * LOGGER_RATE_LIMIT_PER_SECOND;
+    limit.tokens = min(limit.tokens + refill, (uint32_t)LOGGER_RATE_LIMIT_BURST * 1000);
+    limit.lastRefill = now;
+    if (limit.tokens >= 1000) {
+        limit.tokens -= 1000;
+        allowed = true;
+    }
+    portEXIT_CRITICAL(&_rateLimitMux);
+
+    if (!allowed) {
+        __atomic_fetch_add(&_stats.rateLimited, 1, __ATOMIC_RELAXED);
+    }
+    return allowed;
+}
+
+LoggerStats LoggerLib::getStats() const {
+    LoggerStats stats;
+    stats.written = __atomic_load_n(&_stats.written, __ATOMIC_RELAXED);
+    stats.rateLimited = __atomic_load_n(&_stats.rateLimited, __ATOMIC_RELAXED);
+    stats.queueFull = __atomic_load_n(&_stats.queueFull, __ATOMIC_RELAXED);
+    stats.coalesced = __atomic_load_n(&_stats.coalesced, __ATOMIC_RELAXED);
+    stats.batches = __atomic_load_n(&_stats.batches, __ATOMIC_RELAXED);
+    stats.deferred = __atomic_load_n(&_stats.deferred, __ATOMIC_RELAXED);
+    return stats;
+}
+
+void LoggerLib::printStats(Print &out) const {
+    LoggerStats stats = getStats();
+    out.print("written=");
+    out.println((unsigned long)stats.written);
+    out.print("dropped.rate_limited=");
+    out.println((unsigned long)stats.rateLimited);
+    out.print("dropped.queue_full=");
+    out.println((unsigned long)stats.queueFull);
+    out.print("coalesced=");
+    out.println((unsigned long)stats.coalesced);
+    out.print("sd.batches=");
+    out.println((unsigned long)stats.batches);
+    out.print("sd.deferred=");
+    out.println((unsigned long)stats.deferred);
+    out.print("queue.depth=");
+    out.println((unsigned long)uxQueueMessagesWaiting(logQueue));
+    out.print("queue.capacity=");
+    out.println((unsigned long)LOG_QUEUE_LENGTH);
+}
+
+void LoggerLib::printMetrics(Print &out) const {
+    LoggerStats stats = getStats();
+    MetricsLib::printValue(out, "log_lines_total", "counter", "Lines written to Serial and the SD card.", stats.written);
+    MetricsLib::printHeader(out, "log_dropped_total", "counter", "Lines dropped, by reason.");
+    out.printf(METRICS_PREFIX "log_dropped_total{reason=\"rate_limit\"} %lu\n", (unsigned long)stats.rateLimited);
+    out.printf(METRICS_PREFIX "log_dropped_total{reason=\"queue_full\"} %lu\n", (unsigned long)stats.queueFull);
+    MetricsLib::printValue(out, "log_coalesced_total", "counter", "Repeated lines folded into a repeat count.", stats.coalesced);
+    MetricsLib::printValue(out, "log_batches_total", "counter", "Batches of lines written to the SD card.", stats.batches);
+    MetricsLib::printValue(out, "log_deferred_total", "counter", "Batches held back for higher-priority SD traffic.", stats.deferred);
+    MetricsLib::printValue(out, "log_queue_depth", "gauge", "Lines waiting in the log queue.", uxQueueMessagesWaiting(logQueue));
+    MetricsLib::printValue(out, "log_queue_capacity", "gauge", "Size of the log queue.", LOG_QUEUE_LENGTH);
+}
+
 // Method to log messages to both Serial and SD card
 void LoggerLib::log(String message) {
-    String timestamp = EssentialsLib::getTimestamp();
-    String logMessage = "[" + timestamp + "] " + message;
+    if (isEnabled(LOGGER_LEVEL_INFO, "APP")) {
+        log(LOGGER_LEVEL_INFO, "APP", "%s", message.c_str());
+    }
+}
+
+void LoggerLib::log(LogLevel level, const char* tag, const String& message) {
+    log(level, tag, "%s", message.c_str());
+}
+
+void LoggerLib::log(LogLevel level, const char* tag, const char* format, ...) {
+    LogEntry entry;
+    entry.time = EssentialsLib::getElapsedTime();
+    entry.level = level;
+    strncpy(entry.tag, tag, LOGGER_TAG_SIZE - 1);
+    entry.tag[LOGGER_TAG_SIZE - 1] = '\0';
+
+    // vsnprintf truncates messages that do not fit and always terminates the buffer
+    va_list args;
+    va_start(args, format);
+    vsnprintf(entry.text, sizeof(entry.text), format, args);
+    va_end(args);
 
-    // Ensure the message fits within the buffer size, including space for the null terminator
-    if (logMessage.length() >= LOG_MESSAGE_SIZE - 1) {
-        logMessage = logMessage.substring(0, LOG_MESSAGE_SIZE - 2); // Truncate if too long
+    _enqueue(entry);
+}
+
+void LoggerLib::_enqueue(const LogEntry &entry) {
+    // Send the message to the logging task; never wait, a caller must not be slowed down to the speed of the SD card
+    if (xQueueSend(logQueue, &entry, 0) != pdPASS) {
+        __atomic_fetch_add(&_stats.queueFull, 1, __ATOMIC_RELAXED);
     }
+}
 
-    // Create a char array for the log message
-    char logBuffer[LOG_MESSAGE_SIZE];
-    
-    // Convert String to char array and ensure proper null termination
-    logMessage.toCharArray(logBuffer, LOG_MESSAGE_SIZE);
+size_t LoggerLib::_formatLine(const LogEntry &entry, char* line) {
+    static const char levelLetters[] = "VDIWE";
+    char timestamp[ESSENTIALS_TIMESTAMP_SIZE];
+    EssentialsLib::formatTimestamp(timestamp, sizeof(timestamp), entry.time);
 
-    // Send the message to the logging task
-    if (xQueueSend(logQueue, logBuffer, portMAX_DELAY) != pdPASS) {
-        Serial.println("Failed to send log to queue.");
+    int length = snprintf(line, LOG_LINE_SIZE, "[%s] [%c] [%s] %s", timestamp,
+                          levelLetters[entry.level < LOGGER_LEVEL_NONE ? entry.level : LOGGER_LEVEL_ERROR], entry.tag, entry.text);
+    if (length < 0) {
+        line[0] = '\0';
+        return 0;
     }
+    return ((size_t)length < LOG_LINE_SIZE) ? (size_t)length : LOG_LINE_SIZE - 1;
 }
 
-// Internal method to initialize the SD card
-bool LoggerLib::_initializeSD() {
-    // Begin SPI communication with custom pins for SD card
-    SPI.begin(_SD_SCK, _SD_MISO, _SD_MOSI, _SD_CS);
+bool LoggerLib::isEnabled(LogLevel level, const char* tag) const {
+    int index = _findTag(tag);
+    uint8_t threshold = (index >= 0) ? _tagLevels[index].level : _defaultLevel;
+    return level >= threshold && level < LOGGER_LEVEL_NONE;
+}
 
-    // Initialize SD card
-    if (!SD.begin(_SD_CS)) {
-        Serial.println("Card Mount Failed");
-        return false;
+bool LoggerLib::setLevel(const char* tag, LogLevel level) {
+    if (strcmp(tag, "*") == 0) {
+        _defaultLevel = level;
+        return true;
     }
 
-    uint8_t cardType = SD.cardType();
-    if (cardType == CARD_NONE) {
-        Serial.println("No SD card attached");
+    int index = _findTag(tag);
+    if (index >= 0) {
+        _tagLevels[index].level = level;
+        return true;
+    }
+    if (_tagCount >= LOGGER_MAX_TAGS) {
         return false;
     }
 
-    // Check for existing log files and determine the next log number
-    int logNumber = 1; // Start with log_1
-    String existingLogName;
-    
-    // Loop through all files on the SD card
-    File root = SD.open("/Old logs");
-    File file = root.openNextFile();
-    
-    while (file) {
-        String fileName = file.name();
-        
-        // Check if the file name matches the log pattern
-        if (fileName.startsWith("log_")) {
-            // Extract the number from the filename
-            int numberIndex = fileName.indexOf('_') + 1;
-            int numberEndIndex = fileName.indexOf('.', numberIndex);
-            if (numberEndIndex == -1) numberEndIndex = fileName.length(); // If there's no dot, get to the end of the name
-
-            // Parse the number and update logNumber if it's larger
-            int fileLogNumber = fileName.substring(numberIndex, numberEndIndex).toInt();
-            if (fileLogNumber >= logNumber) {
-                logNumber = fileLogNumber + 1; // Increment for the next available log number
-            }
-        }
-        
-        file.close();
-        file = root.openNextFile(); // Continue to the next file
+    // Fill the entry before publishing it so readers on other tasks never see a half-written tag
+    TagLevel &entry = _tagLevels[_tagCount];
+    strncpy(entry.tag, tag, LOGGER_TAG_SIZE - 1);
+    entry.tag[LOGGER_TAG_SIZE - 1] = '\0';
+    entry.level = level;
+    __sync_synchronize();
+    _tagCount = _tagCount + 1;
+    return true;
+}
+
+LogLevel LoggerLib::getLevel(const char* tag) const {
+    int index = _findTag(tag);
+    return (LogLevel)((index >= 0) ? _tagLevels[index].level : _defaultLevel);
+}
+
+void LoggerLib::printLevels(Print &out) const {
+    out.print("*=");
+    out.println(levelName((LogLevel)_defaultLevel));
+    for (int i = 0; i < _tagCount; i++) {
+        out.print(_tagLevels[i].tag);
+        out.print("=");
+        out.println(levelName((LogLevel)_tagLevels[i].level));
     }
-    
-    // Rename the existing log file to "log_#"
-    if (SD.exists(_logFileName)) {
-        existingLogName = _logFileName; // Store the current log file name
-        String newLogFileName = "/Old logs/log_" + String(logNumber) + ".txt"; // Create new log file name
-
-        // Open the existing log file for reading
-        File sourceFile = SD.open(_logFileName, FILE_READ);
-        if (!sourceFile) {
-            Serial.println("Failed to open source log file.");
-        }
+}
 
-        // Create the new log file for writing
-        File backupFile = SD.open(newLogFileName, FILE_WRITE);
-        if (!backupFile) {
-            Serial.println("Failed to create backup log file.");
-            sourceFile.close();
-        }
+const char* LoggerLib::levelName(LogLevel level) {
+    static const char* names[] = {"VERBOSE", "DEBUG", "INFO", "WARN", "ERROR", "NONE"};
+    return names[level <= LOGGER_LEVEL_NONE ? level : LOGGER_LEVEL_NONE];
+}
 
-        Serial.println("Copying data to " + newLogFileName + ", from " + existingLogName);
+bool LoggerLib::parseLevel(const char* name, LogLevel &level) {
+    if (name[0] >= '0' && name[0] <= '5' && name[1] == '\0') {
+        level = (LogLevel)(name[0] - '0');
+        return true;
+    }
+    for (int i = LOGGER_LEVEL_VERBOSE; i <= LOGGER_LEVEL_NONE; i++) {
+        if (strcasecmp(name, levelName((LogLevel)i)) == 0) {
+            level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
 
-        while (sourceFile.available())
-        {
-            backupFile.write(sourceFile.read());
+int LoggerLib::_findTag(const char* tag) const {
+    for (int i = 0; i < _tagCount; i++) {
+        if (strncmp(_tagLevels[i].tag, tag, LOGGER_TAG_SIZE - 1) == 0) {
+            return i;
         }
+    }
+    return -1;
+}
 
-        // Close both files after copying
-        sourceFile.close();
-        backupFile.close();
-        Serial.println("Finished copying to the new log file.");
+// Internal method to initialize the SD card
+bool LoggerLib::_initializeSD() {
+    // Mount the card (a no-op if another library already did)
+    if (!_storage->begin()) {
+        return false;
+    }
+    StorageLock lock(_storage, STORAGE_IO_BACKGROUND);
+
+    // Archive the previous log by renaming it: constant time, however many archives there are
+    _loadRotationState();
+    File previousLog = _storage->fs().open(_logFileName, FILE_READ);
+    bool keepPrevious = previousLog && previousLog.size() > 0;
+    previousLog.close();
+    if (keepPrevious && _archiveLogFile()) {
+        keepPrevious = false;
     }
 
-    // Create a new log file
-    File logFile = SD.open(_logFileName, FILE_WRITE, true); // Open the new log file for writing
-    if (logFile) {
-        logFile.close();  // Just open and close to create the file
+    // Create a new log file (or keep appending if it could not be archived) and keep it open
+    // Times restart at every boot, so appending to the previous boot's log starts a new index;
+    // its lines stay in the file but are only reachable by downloading it whole
+    _openLogFile(keepPrevious, false);
+    if (_logFile) {
         Serial.println("New log file created.");
     } else {
         Serial.println("Failed to open new log file.");
     }
 
+    _latestLogFile = _storage->fs().open(LATEST_LOG, FILE_WRITE, true);
+    _latestLogSize = 0;
+
+    return true;
+}
+
+void LoggerLib::_loadRotationState() {
+    char state[80] = {};
+    File stateFile = _storage->fs().open(ROTATION_STATE_FILE, FILE_READ);
+    if (stateFile) {
+        stateFile.read((uint8_t*)state, sizeof(state) - 1);
+        stateFile.close();
+    }
+
+    unsigned long next = 0;
+    unsigned long oldest = 0;
+    unsigned long long bytes = 0;
+    int fields = sscanf(state, "next=%lu oldest=%lu bytes=%llu", &next, &oldest, &bytes);
+    if (fields >= 2 && next >= 1 && oldest >= 1 && oldest <= next) {
+        _nextArchive = next;
+        _oldestArchive = oldest;
+        _archiveBytes = bytes;
+        if (fields == 2) {
+            _countArchiveBytes(); // State written before the byte total was kept
+            _saveRotationState();
+        }
+        return;
+    }
+
+    // No usable state yet: find the numbering of the existing archives once
+    Serial.println("No log rotation state, scanning /Old logs once.");
+    _nextArchive = 1;
+    _oldestArchive = UINT32_MAX;
+    File root = _storage->fs().open(ARCHIVE_DIR);
+    if (!root) {
+        _storage->fs().mkdir(ARCHIVE_DIR);
+    }
+    File file = root ? root.openNextFile() : File();
+    while (file) {
+        const char* fileName = file.name();
+        if (strncmp(fileName, "log_", 4) == 0) {
+            uint32_t number = (uint32_t)atol(fileName + 4);
+            if (number >= _nextArchive) _nextArchive = number + 1;
+            if (number >= 1 && number < _oldestArchive) _oldestArchive = number;
+        }
+        file.close();
+        file = root.openNextFile();
+    }
+    root.close();
+    if (_oldestArchive > _nextArchive) {
+        _oldestArchive = _nextArchive;
+    }
+    _countArchiveBytes();
+    _saveRotationState();
+}
+
+void LoggerLib::_countArchiveBytes() {
+    _archiveBytes = 0;
+    char archive[40];
+    for (uint32_t number = _oldestArchive; number < _nextArchive; number++) {
+        _archivePath(archive, sizeof(archive), number, "txt");
+        File file = _storage->fs().open(archive, FILE_READ);
+        if (file) {
+            _archiveBytes += file.size();
+            file.close();
+        }
+    }
+}
+
+void LoggerLib::_saveRotationState() {
+    File stateFile = _storage->fs().open(ROTATION_STATE_FILE, FILE_WRITE);
+    if (!stateFile) {
+        Serial.println("Failed to write the log rotation state.");
+        return;
+    }
+    char state[80];
+    int length = snprintf(state, sizeof(state), "next=%lu oldest=%lu bytes=%llu\n", (unsigned long)_nextArchive, (unsigned long)_oldestArchive, (unsigned long long)_archiveBytes);
+    stateFile.write((const uint8_t*)state, length);
+    stateFile.close();
+}
+
+void LoggerLib::_archivePath(char* path, size_t size, uint32_t number, const char* extension) {
+    snprintf(path, size, ARCHIVE_DIR "/log_%lu.%s", (unsigned long)number, extension);
+}
+
+void LoggerLib::_indexPath(char* path, size_t size, const char* logPath) {
+    // Same name with the extension swapped: /log/full.log -> /log/full.idx
+    const char* dot = strrchr(logPath, '.');
+    const char* slash = strrchr(logPath, '/');
+    int stem = (dot != nullptr && dot > slash) ? (int)(dot - logPath) : (int)strlen(logPath);
+    snprintf(path, size, "%.*s.idx", stem, logPath);
+}
+
+bool LoggerLib::_archiveLogFile() {
+    char archive[40];
+    _archivePath(archive, sizeof(archive), _nextArchive, "txt");
+
+    // FAT will not rename over an existing file; skip numbers taken behind the state file's back
+    for (int attempt = 0; attempt < 8 && _storage->fs().exists(archive); attempt++) {
+        _nextArchive++;
+        _archivePath(archive, sizeof(archive), _nextArchive, "txt");
+    }
+    if (!_storage->fs().rename(_logFileName, archive)) {
+        Serial.printf("Failed to archive %s as %s\n", _logFileName, archive);
+        return false;
+    }
+    Serial.printf("Archived %s as %s\n", _logFileName, archive);
+    File archived = _storage->fs().open(archive, FILE_READ);
+    if (archived) {
+        _archiveBytes += archived.size();
+        archived.close();
+    }
+
+    // The time index travels with its log
+    char index[40];
+    char archiveIndex[40];
+    _indexPath(index, sizeof(index), _logFileName);
+    _archivePath(archiveIndex, sizeof(archiveIndex), _nextArchive, "idx");
+    _storage->fs().remove(archiveIndex);
+    _storage->fs().rename(index, archiveIndex);
+    _nextArchive++;
+
+    _pruneArchives();
+    _saveRotationState();
     return true;
 }
 
-// Simplified method to append log messages directly to SD card
-void LoggerLib::_writeToSD(String message, SemaphoreHandle_t &logFileMutex) {
-    if (xSemaphoreTake(logFileMutex, portMAX_DELAY) == pdTRUE) {
-        File logFile = SD.open(_logFileName, FILE_APPEND);
-        if (logFile) {
-            logFile.println(message);
-            logFile.flush();
-            logFile.close();
-        } else {
-            Serial.println("Failed to open log file.");
+void LoggerLib::_pruneArchives() {
+    // Archives are numbered consecutively, so pruning only looks at the oldest ones
+    uint64_t freeBytes = _storage->getFreeBytes();
+    char archive[40];
+    while (_oldestArchive < _nextArchive &&
+           (_nextArchive - _oldestArchive > LOGGER_RETENTION_COUNT || _archiveBytes > LOGGER_RETENTION_BYTES || freeBytes < LOGGER_MIN_FREE_BYTES)) {
+        _archivePath(archive, sizeof(archive), _oldestArchive, "txt");
+        File file = _storage->fs().open(archive, FILE_READ);
+        size_t size = file ? file.size() : 0;
+        file.close();
+        _storage->fs().remove(archive);
+        _archivePath(archive, sizeof(archive), _oldestArchive, "idx");
+        _storage->fs().remove(archive);
+        _oldestArchive++;
+
+        _archiveBytes = _archiveBytes > size ? _archiveBytes - size : 0;
+        freeBytes += size;
+        Serial.printf("Deleted log archive %lu (%lu bytes)\n", (unsigned long)(_oldestArchive - 1), (unsigned long)size);
+    }
+}
+
+void LoggerLib::_openLogFile(bool append, bool keepIndex) {
+    char index[40];
+    _indexPath(index, sizeof(index), _logFileName);
+
+    _logFile = _storage->fs().open(_logFileName, append ? FILE_APPEND : FILE_WRITE, true);
+    _indexFile = _storage->fs().open(index, keepIndex ? FILE_APPEND : FILE_WRITE, true);
+    _logFileSize = _logFile ? _logFile.size() : 0;
+    _nextIndexOffset = _logFileSize; // Index the first line written to this file
+    _logFileOpened = EssentialsLib::getElapsedTime();
+}
+
+void LoggerLib::_rotate() {
+    _logFile.close();
+    _indexFile.close();
+    uint32_t archived = _nextArchive;
+    bool moved = _archiveLogFile();
+
+    _openLogFile(!moved, !moved); // Same boot, so the index stays in time order
+    if (moved && _logFile) {
+        // Leave a pointer to the previous part at the top of the new file
+        LogEntry entry;
+        entry.time = _logFileOpened;
+        entry.level = LOGGER_LEVEL_INFO;
+        snprintf(entry.tag, sizeof(entry.tag), "%s", LOG_TAG);
+        snprintf(entry.text, sizeof(entry.text), "Continued from " ARCHIVE_DIR "/log_%lu.txt", (unsigned long)archived);
+        char line[LOG_LINE_SIZE];
+        size_t length = _formatLine(entry, line);
+        _appendLine(line, length, entry.time);
+    }
+}
+
+void LoggerLib::_appendLine(const char* line, size_t length, unsigned long time) {
+    // Every LOGGER_INDEX_INTERVAL bytes, note where this line starts and when it was logged
+    if (_logFileSize >= _nextIndexOffset && _indexFile) {
+        uint32_t record[2] = {(uint32_t)time, (uint32_t)_logFileSize};
+        _indexFile.write((const uint8_t*)record, sizeof(record));
+        _indexFile.flush();
+        _nextIndexOffset = _logFileSize + LOGGER_INDEX_INTERVAL;
+    }
+
+    _logFileSize += _logFile.write((const uint8_t*)line, length);
+    _logFileSize += _logFile.write((const uint8_t*)"\r\n", 2);
+}
+
+// Simplified method to append log lines directly to SD card
+void LoggerLib::_writeToSD(const char* line, size_t length, unsigned long time) {
+    if (_logFile) {
+        _appendLine(line, length, time);
+
+        // Size- and age-based rollover while running, not only at boot
+        bool tooOld = LOGGER_ROTATE_AGE_MS > 0 && EssentialsLib::getElapsedTime() - _logFileOpened >= LOGGER_ROTATE_AGE_MS;
+        if (_logFileSize >= LOGGER_ROTATE_SIZE || tooOld) {
+            _rotate();
         }
-        xSemaphoreGive(logFileMutex);  // Release the mutex after writing
     } else {
-        Serial.println("Failed to acquire SD mutex.");
+        Serial.println("Failed to open log file.");
     }
 }
 
-void LoggerLib::_writeLatestLogToSD(SemaphoreHandle_t &latestLogFileMutex) {
-    if (xSemaphoreTake(latestLogFileMutex, portMAX_DELAY) == pdTRUE) {
-        File logFile = SD.open("/log/latest.log", FILE_WRITE, true);
-        if (logFile) {
-            logFile.seek(0);  // Overwrite the entire file
-            for (int i = 0; i < MAX_LOG_MESSAGES; i++) {
-                int idx = (logIndex + i) % MAX_LOG_MESSAGES;  // Circular buffer indexing
-                if (bufferFull || idx < logIndex) {
-                    logFile.println(logMessages[idx]);  // Write message to SD
+bool LoggerLib::_resolveLogFile(const char* file, char* logPath, char* indexPath, size_t size) {
+    if (file == nullptr || file[0] == '\0' || strcmp(file, "full") == 0) {
+        snprintf(logPath, size, "%s", _logFileName);
+        _indexPath(indexPath, size, _logFileName);
+        return true;
+    }
+
+    char* end;
+    unsigned long number = strtoul(file, &end, 10);
+    if (*end != '\0' || number == 0) {
+        return false;
+    }
+    _archivePath(logPath, size, number, "txt");
+    _archivePath(indexPath, size, number, "idx");
+    return true;
+}
+
+void LoggerLib::getArchiveRange(uint32_t &first, uint32_t &last) const {
+    first = _oldestArchive;
+    last = _nextArchive - 1;
+}
+
+bool LoggerLib::hasLog(const char* file) {
+    char logPath[40];
+    char indexPath[40];
+    if (!_resolveLogFile(file, logPath, indexPath, sizeof(logPath))) {
+        return false;
+    }
+
+    StorageLock lock(_storage, STORAGE_IO_INTERACTIVE);
+    return _storage->fs().exists(logPath);
+}
+
+bool LoggerLib::getLogPath(const char* file, char* path, size_t size) {
+    char indexPath[40];
+    return _resolveLogFile(file, path, indexPath, size < sizeof(indexPath) ? size : sizeof(indexPath));
+}
+
+long LoggerLib::copyLog(Print &out, const char* file) {
+    char logPath[40];
+    char indexPath[40];
+    if (!_resolveLogFile(file, logPath, indexPath, sizeof(logPath))) {
+        return -1;
+    }
+
+    _storage->lock(STORAGE_IO_INTERACTIVE);
+    File logFile = _storage->fs().open(logPath, FILE_READ);
+    _storage->unlock();
+    if (!logFile || logFile.isDirectory()) {
+        return -1;
+    }
+
+    uint8_t chunk[HTML_COPY_CHUNK_SIZE];
+    long copied = 0;
+    size_t count;
+    while ((count = _storage->read(logFile, chunk, sizeof(chunk))) > 0) {
+        out.write(chunk, count);
+        copied += count;
+    }
+
+    _storage->lock();
+    logFile.close();
+    _storage->unlock();
+    return copied;
+}
+
+long LoggerLib::queryLog(Print &out, const char* file, unsigned long from, unsigned long to, const char* match) {
+    char logPath[40];
+    char indexPath[40];
+    if (!_resolveLogFile(file, logPath, indexPath, sizeof(logPath))) {
+        return -1;
+    }
+
+    // Only the lookup holds the card; the lines are streamed one chunk at a time below
+    _storage->lock(STORAGE_IO_INTERACTIVE);
+    File logFile = _storage->fs().open(logPath, FILE_READ);
+    if (!logFile || logFile.isDirectory()) {
+        _storage->unlock();
+        return -1;
+    }
+
+    // Binary search the index for the last checkpoint at or before `from`, then start one checkpoint
+    // earlier: lines from both cores can reach the file slightly out of order. Without an index, start
+    // at the top; before the first checkpoint, start there (lines before it are from an earlier boot)
+    uint32_t offset = 0;
+    File indexFile = _storage->fs().open(indexPath, FILE_READ);
+    if (indexFile) {
+        uint32_t low = 0;
+        uint32_t high = indexFile.size() / LOG_INDEX_RECORD_SIZE;
+        while (low < high) {
+            uint32_t middle = low + (high - low) / 2;
+            uint32_t record[2];
+            indexFile.seek(middle * LOG_INDEX_RECORD_SIZE);
+            if (indexFile.read((uint8_t*)record, sizeof(record)) != sizeof(record)) {
+                high = middle;
+                break;
+            }
+            if (record[0] <= from) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        uint32_t record[2];
+        indexFile.seek((low >= 2 ? low - 2 : 0) * LOG_INDEX_RECORD_SIZE);
+        if (indexFile.read((uint8_t*)record, sizeof(record)) == sizeof(record)) {
+            offset = record[1];
+        }
+        indexFile.close();
+    }
+    logFile.seek(offset);
+    _storage->unlock();
+
+    // Stream whole lines from there until LOGGER_INDEX_INTERVAL bytes past the first one logged after
+    // `to`, which catches lines of the window that were written after it
+    char chunk[HTML_COPY_CHUNK_SIZE];
+    size_t slack = 0;
+    bool pastEnd = false;
+    char line[LOG_LINE_SIZE];
+    size_t lineLength = 0;
+    bool lineTruncated = false;
+    long matched = 0;
+    bool done = false;
+    size_t count;
+    while (!done && (count = _storage->read(logFile, (uint8_t*)chunk, sizeof(chunk))) > 0) {
+        for (size_t i = 0; i < count && !done; i++) {
+            char c = chunk[i];
+            if (pastEnd && ++slack >= LOGGER_INDEX_INTERVAL) {
+                done = true;
+                break;
+            }
+            if (c != '\n') {
+                if (c != '\r' && lineLength < sizeof(line) - 1) line[lineLength++] = c;
+                else if (c != '\r') lineTruncated = true;
+                continue;
+            }
+
+            line[lineLength] = '\0';
+            unsigned long time;
+            if (line[0] == '[' && EssentialsLib::parseTimestamp(line + 1, time)) {
+                if (time > to) {
+                    pastEnd = true;
+                } else if (time >= from && (match == nullptr || match[0] == '\0' || strstr(line, match) != nullptr)) {
+                    out.write((const uint8_t*)line, lineLength);
+                    out.print(lineTruncated ? "...\n" : "\n");
+                    matched++;
                 }
             }
-            logFile.flush();
-            logFile.close();
-        } else {
-            Serial.println("Failed to open latest_log.txt for writing.");
+            lineLength = 0;
+            lineTruncated = false;
         }
-        xSemaphoreGive(latestLogFileMutex);
     }
-}
 
-// Internal method to print log messages to Serial
-void LoggerLib::_writeToSerial(String message) {
-    Serial.println(message);
+    _storage->lock();
+    logFile.close();
+    _storage->unlock();
+    return matched;
 }
 
-// Function to update the index.html file with the latest log
-void LoggerLib::updateHtmlLog(SemaphoreHandle_t &latestLogFileMutex, SemaphoreHandle_t &logHTMLFileMutex) {
-    if (xSemaphoreTake(latestLogFileMutex, portMAX_DELAY) == pdTRUE) {
-        File logFile = SD.open("/log/latest.log");
-        if (!logFile) {
-            log("Failed to open latest_log.txt for reading");
-            xSemaphoreGive(latestLogFileMutex);
-            return;
-        }
+size_t LoggerLib::_writeLatestLogToSD() {
+    StorageLock lock(_storage, STORAGE_IO_BACKGROUND);
 
-        String htmlContent = "<!DOCTYPE html><html><head><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\"> <link rel=\"stylesheet\" href=\"https://cdn.jsdelivr.net/npm/bulma@1.0.2/css/bulma.min.css\">";
-        htmlContent += "<pre>";
+    // A file cannot be truncated through an open handle, so it is reopened (and so emptied) when the
+    // lines are shorter than what is there; otherwise they simply overwrite it in place
+    size_t size = 0;
+    for (int i = 0; i < MAX_LOG_MESSAGES; i++) {
+        int idx = (logIndex + i) % MAX_LOG_MESSAGES;
+        if (bufferFull || idx < logIndex) {
+            size += logLengths[idx] + 2;
+        }
+    }
+    if (size < _latestLogSize) {
+        _latestLogFile.close();
+        _latestLogFile = _storage->fs().open(LATEST_LOG, FILE_WRITE, true);
+    }
 
-        while (logFile.available()) {
-            String logLine = logFile.readStringUntil('\n');
-            htmlContent += logLine + "<br>";
+    size_t written = 0;
+    if (_latestLogFile) {
+        _latestLogFile.seek(0);  // Overwrite the entire file
+        for (int i = 0; i < MAX_LOG_MESSAGES; i++) {
+            int idx = (logIndex + i) % MAX_LOG_MESSAGES;  // Circular buffer indexing
+            if (bufferFull || idx < logIndex) {
+                written += _latestLogFile.write((const uint8_t*)logMessages[idx], logLengths[idx]);  // Write message to SD
+                written += _latestLogFile.write((const uint8_t*)"\r\n", 2);
+            }
         }
+        _latestLogSize = written;
+        _latestLogFile.flush();
+    } else {
+        Serial.println("Failed to open latest_log.txt for writing.");
+    }
+    return written;
+}
+
+// Internal method to print log lines to Serial
+void LoggerLib::_writeToSerial(const char* line, size_t length) {
+    Serial.write((const uint8_t*)line, length);
+    Serial.println();
+}
 
-        logFile.close();  // Close the log file
-        xSemaphoreGive(latestLogFileMutex);  // Release the mutex
+// Function to update the index.html file with the latest log
+void LoggerLib::updateHtmlLog() {
+    TRACE_SCOPE("log.html");
+    // Held throughout, so the logging task cannot rewrite latest.log halfway through the copy
+    StorageLock lock(_storage, STORAGE_IO_INTERACTIVE);
+    File logFile = _storage->fs().open(LATEST_LOG);
+    if (!logFile) {
+        if (isEnabled(LOGGER_LEVEL_ERROR, LOG_TAG)) log(LOGGER_LEVEL_ERROR, LOG_TAG, "Failed to open latest_log.txt for reading");
+        return;
+    }
 
-        htmlContent += "</pre></body></html>";
+    File htmlFile = _storage->fs().open("/log/index.html", FILE_WRITE);
+    if (!htmlFile) {
+        logFile.close();
+        if (isEnabled(LOGGER_LEVEL_ERROR, LOG_TAG)) log(LOGGER_LEVEL_ERROR, LOG_TAG, "Failed to open /log/index.html for writing");
+        return;
+    }
 
-        if (xSemaphoreTake(logHTMLFileMutex, portMAX_DELAY) == pdTRUE) {
-            File htmlFile = SD.open("/log/index.html", FILE_WRITE);
-            if (!htmlFile) {
-                log("Failed to open /log/index.html for writing");
-                return;
+    htmlFile.print("<!DOCTYPE html><html><head><meta name=\"viewport\" content=\"width=device-width, initial-scale=1\"> <link rel=\"stylesheet\" href=\"https://cdn.jsdelivr.net/npm/bulma@1.0.2/css/bulma.min.css\">");
+    htmlFile.print("<pre>");
+
+    // Copy the log in fixed-size chunks, turning line breaks into <br>
+    uint8_t chunk[HTML_COPY_CHUNK_SIZE];
+    size_t count;
+    while ((count = logFile.read(chunk, sizeof(chunk))) > 0) {
+        size_t start = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (chunk[i] == '\r' || chunk[i] == '\n') {
+                htmlFile.write(chunk + start, i - start);
+                if (chunk[i] == '\n') htmlFile.print("<br>");
+                start = i + 1;
             }
-
-            htmlFile.print(htmlContent);  // Write the HTML content
-            htmlFile.close();  // Close the HTML file
-            xSemaphoreGive(logHTMLFileMutex);  // Release the mutex
         }
+        htmlFile.write(chunk + start, count - start);
     }
+
+    htmlFile.print("</pre></body></html>");
+    htmlFile.close();  // Close the HTML file
+    logFile.close();  // Close the log file
 }
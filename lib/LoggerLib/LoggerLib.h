@@ -9,10 +9,121 @@
 
 #include <Arduino.h>
 #include <FS.h>
-#include <SPI.h>
-#include <SD.h>
+#include "StorageLib.h"
 #include <queue.h>  // Include for FreeRTOS queue
 
+/**
+ * @brief Log severities, from most to least verbose.
+ */
+enum LogLevel : uint8_t {
+    LOGGER_LEVEL_VERBOSE = 0, /**< Per-request chatter (client connected, file streamed, ...) */
+    LOGGER_LEVEL_DEBUG,       /**< Diagnostic detail useful while developing */
+    LOGGER_LEVEL_INFO,        /**< Normal operational milestones */
+    LOGGER_LEVEL_WARN,        /**< Something unexpected that was recovered from */
+    LOGGER_LEVEL_ERROR,       /**< An operation failed */
+    LOGGER_LEVEL_NONE         /**< Disables a tag entirely */
+};
+
+/**
+ * @brief Lowest level that is compiled in. Calls below it are removed by the compiler,
+ *        arguments included. Override with e.g. `-DLOGGER_COMPILE_LEVEL=LOGGER_LEVEL_INFO`.
+ */
+#ifndef LOGGER_COMPILE_LEVEL
+#define LOGGER_COMPILE_LEVEL LOGGER_LEVEL_DEBUG
+#endif
+
+/**
+ * @brief Level every tag starts at until changed with LoggerLib::setLevel().
+ */
+#ifndef LOGGER_DEFAULT_LEVEL
+#define LOGGER_DEFAULT_LEVEL LOGGER_LEVEL_INFO
+#endif
+
+#define LOGGER_MAX_TAGS 8 /**< Number of tags that can have their own runtime level */
+#define LOGGER_TAG_SIZE 8 /**< Maximum tag length, including the terminator */
+
+#ifndef LOG_MESSAGE_SIZE
+#define LOG_MESSAGE_SIZE 256 /**< Longest message body; longer messages are truncated */
+#endif
+#define LOG_LINE_SIZE (LOG_MESSAGE_SIZE + 40) /**< Message plus "[timestamp] [L] [TAG] " prefix */
+
+#ifndef LOGGER_RATE_LIMIT_BURST
+#define LOGGER_RATE_LIMIT_BURST 10 /**< Lines a single call site may log back to back */
+#endif
+#ifndef LOGGER_RATE_LIMIT_PER_SECOND
+#define LOGGER_RATE_LIMIT_PER_SECOND 2 /**< Sustained lines per second per call site once the burst is used up */
+#endif
+
+#ifndef LOGGER_ROTATE_SIZE
+#define LOGGER_ROTATE_SIZE (1024UL * 1024UL) /**< full.log is archived once it reaches this many bytes */
+#endif
+#ifndef LOGGER_ROTATE_AGE_MS
+#define LOGGER_ROTATE_AGE_MS (24UL * 60UL * 60UL * 1000UL) /**< ... or has been written to for this long; 0 disables */
+#endif
+#ifndef LOGGER_INDEX_INTERVAL
+#define LOGGER_INDEX_INTERVAL 4096 /**< Bytes of log between two entries of the time index */
+#endif
+#ifndef LOGGER_SERIAL_WAIT_MS
+#define LOGGER_SERIAL_WAIT_MS 0 /**< How long beginSerial() waits for a USB serial host to connect */
+#endif
+#ifndef LOGGER_BATCH_LINES
+#define LOGGER_BATCH_LINES 32 /**< Lines held back at most before they are written to the SD card regardless */
+#endif
+#ifndef LOGGER_BATCH_MAX_DELAY_MS
+#define LOGGER_BATCH_MAX_DELAY_MS 1000 /**< Longest a line is held back while firmware or HTTP traffic uses the card */
+#endif
+#ifndef LOGGER_RETENTION_COUNT
+#define LOGGER_RETENTION_COUNT 50 /**< Archives kept in /Old logs; the oldest are deleted beyond this */
+#endif
+#ifndef LOGGER_RETENTION_BYTES
+#define LOGGER_RETENTION_BYTES (32ULL * 1024 * 1024) /**< ... or beyond this many bytes of archived logs */
+#endif
+#ifndef LOGGER_MIN_FREE_BYTES
+#define LOGGER_MIN_FREE_BYTES (8ULL * 1024 * 1024) /**< ... or while the card has less free space than this */
+#endif
+
+/**
+ * @brief Token bucket of one LOG_x call site. Zero-initialised static storage, so declaring
+ *        one costs no guard variable and no constructor call.
+ */
+struct LogRateLimit {
+    uint32_t lastRefill; /**< millis() of the last refill */
+    uint32_t tokens;     /**< Available tokens, in thousandths of a line */
+    bool primed;         /**< False until the bucket has been filled the first time */
+};
+
+/**
+ * @brief Logs through a LoggerLib pointer if the level is compiled in and enabled for the tag,
+ *        and the call site has not exceeded its rate limit. The message arguments are only
+ *        evaluated when the line will actually be queued.
+ */
+#define LOG_AT(logger, level, tag, ...) do { \
+        if ((level) >= LOGGER_COMPILE_LEVEL && (logger) != nullptr && (logger)->isEnabled((level), (tag))) { \
+            static LogRateLimit _logRateLimit; \
+            if ((logger)->allow(_logRateLimit)) { \
+                (logger)->log((level), (tag), __VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
+#define LOG_V(logger, tag, ...) LOG_AT(logger, LOGGER_LEVEL_VERBOSE, tag, __VA_ARGS__)
+#define LOG_D(logger, tag, ...) LOG_AT(logger, LOGGER_LEVEL_DEBUG, tag, __VA_ARGS__)
+#define LOG_I(logger, tag, ...) LOG_AT(logger, LOGGER_LEVEL_INFO, tag, __VA_ARGS__)
+#define LOG_W(logger, tag, ...) LOG_AT(logger, LOGGER_LEVEL_WARN, tag, __VA_ARGS__)
+#define LOG_E(logger, tag, ...) LOG_AT(logger, LOGGER_LEVEL_ERROR, tag, __VA_ARGS__)
+
+/**
+ * @brief Counters of lines that did not make it to the log as written.
+ */
+struct LoggerStats {
+    uint32_t written;          /**< Lines written to Serial and the SD card */
+    uint32_t rateLimited;      /**< Lines dropped by a call site's rate limit */
+    uint32_t queueFull;        /**< Lines dropped because the queue was full */
+    uint32_t coalesced;        /**< Repeats folded into "last message repeated N times" */
+    uint32_t batches;          /**< Batches of lines written to the SD card */
+    uint32_t deferred;         /**< Times a batch was held back for higher-priority SD traffic */
+};
+
 /**
  * @class LoggerLib
  * @brief A library for managing logging on SD cards and Serial communication, 
@@ -21,14 +132,11 @@
 class LoggerLib {
     public:
         /**
-         * @brief Constructs a LoggerLib instance.
-         * @param SD_CS SD card chip-select pin.
-         * @param SD_MISO SD card MISO pin.
-         * @param SD_MOSI SD card MOSI pin.
-         * @param SD_SCK SD card SCK pin.
+         * @brief Constructs a LoggerLib instance. Does not touch the SD card until begin().
+         * @param storage Storage that owns the SD card.
          * @param logFileName Name of the primary log file (must not be "latest_log.txt").
          */
-        LoggerLib(int SD_CS = 5, int SD_MISO = 2, int SD_MOSI = 19, int SD_SCK = 18, String logFileName = "full.log");
+        LoggerLib(StorageLib* storage, String logFileName = "full.log");
 
         /**
          * @brief Initializes the logger by starting Serial communication and 
@@ -37,36 +145,218 @@ class LoggerLib {
          */
         void begin(long baudRate = 115200);
 
+        /**
+         * @brief First half of begin(): starts Serial, waiting at most LOGGER_SERIAL_WAIT_MS for it.
+         * @param baudRate The baud rate for Serial communication.
+         */
+        void beginSerial(long baudRate = 115200);
+
+        /**
+         * @brief Second half of begin(): mounts the SD card if needed, archives the previous
+         *        log and opens new log files. Lines logged before this are kept in the queue.
+         * @return True if the log files are open.
+         */
+        bool beginLogFiles();
+
         /**
          * @brief Task for handling the logging of messages from a queue.
-         * @param logFileMutex Semaphore to protect the log file access.
-         * @param latestLogFileMutex Semaphore to protect the latest log file access.
          * @param pvParameters Task parameters, generally unused.
          */
-        void taskLog(SemaphoreHandle_t &logFileMutex, SemaphoreHandle_t &latestLogFileMutex, void *pvParameters);
+        void taskLog(void *pvParameters);
 
         /**
          * @brief Logs a message to both Serial and the SD card by adding it to the queue.
+         *        Kept for existing callers; logs at INFO under the "APP" tag.
          * @param message The message to log.
          */
         void log(String message);
 
+        /**
+         * @brief Logs a leveled, tagged message. Prefer the LOG_x macros, which skip
+         *        building the message when the level is disabled.
+         * @param level Severity of the message.
+         * @param tag Short component name, e.g. "WEB".
+         * @param message The message to log.
+         */
+        void log(LogLevel level, const char* tag, const String& message);
+
+        /**
+         * @brief Logs a leveled, tagged, printf-style message. The message is formatted straight
+         *        into the queue entry, so logging never touches the heap.
+         * @param level Severity of the message.
+         * @param tag Short component name, e.g. "WEB".
+         * @param format printf format string.
+         */
+        void log(LogLevel level, const char* tag, const char* format, ...) __attribute__((format(printf, 4, 5)));
+
+        /**
+         * @brief Checks whether a message would be logged at runtime.
+         * @param level Severity of the message.
+         * @param tag Component tag.
+         * @return True if the tag's threshold lets the level through.
+         */
+        bool isEnabled(LogLevel level, const char* tag) const;
+
+        /**
+         * @brief Takes a token from a call site's bucket. Used by the LOG_x macros.
+         * @param limit Bucket of the call site.
+         * @return True if the line may be logged; false if it is dropped (and counted).
+         */
+        bool allow(LogRateLimit &limit);
+
+        /**
+         * @brief Returns a snapshot of the drop and coalesce counters.
+         */
+        LoggerStats getStats() const;
+
+        /**
+         * @brief Writes the counters and the current queue depth as "name=value" lines.
+         * @param out Destination, e.g. a web client.
+         */
+        void printStats(Print &out) const;
+
+        /**
+         * @brief Writes the counters and queue depth in the Prometheus text format.
+         */
+        void printMetrics(Print &out) const;
+
+        /**
+         * @brief Sets the runtime threshold of a tag.
+         * @param tag Component tag, or "*" to change the default for tags without their own level.
+         * @param level New threshold.
+         * @return False if the tag table is full.
+         */
+        bool setLevel(const char* tag, LogLevel level);
+
+        /**
+         * @brief Gets the runtime threshold that applies to a tag.
+         * @param tag Component tag, or "*" for the default.
+         * @return The tag's threshold, or the default if it has none.
+         */
+        LogLevel getLevel(const char* tag) const;
+
+        /**
+         * @brief Writes the default and per-tag thresholds as "tag=LEVEL" lines.
+         * @param out Destination, e.g. a web client.
+         */
+        void printLevels(Print &out) const;
+
+        /**
+         * @brief Returns the upper-case name of a level ("INFO", ...).
+         */
+        static const char* levelName(LogLevel level);
+
+        /**
+         * @brief Parses a level name (case-insensitive) or its number.
+         * @param name Text to parse.
+         * @param level Receives the parsed level.
+         * @return True on success.
+         */
+        static bool parseLevel(const char* name, LogLevel &level);
+
+        /**
+         * @brief Streams the lines of a log logged between two times, optionally only those
+         *        containing a substring. Seeks via the log's time index, so the cost depends
+         *        on the size of the result rather than the size of the log.
+         * @param out Destination, e.g. a web client.
+         * @param file "full" (or empty) for the current log, or the number N of "/Old logs/log_N.txt".
+         * @param from First time to include, in ms since boot (as in the line timestamps).
+         * @param to Last time to include, in ms since boot.
+         * @param match Substring a line must contain; nullptr or empty for all lines.
+         * @return Number of lines written, or -1 if the log does not exist.
+         */
+        long queryLog(Print &out, const char* file, unsigned long from, unsigned long to, const char* match);
+
+        /**
+         * @brief Streams a whole log as it is on the card, one chunk at a time.
+         * @param out Destination, e.g. a compressor in front of a web client.
+         * @param file "full" (or empty) for the current log, or the number N of "/Old logs/log_N.txt".
+         * @return Number of bytes written, or -1 if the log does not exist.
+         */
+        long copyLog(Print &out, const char* file);
+
+        /**
+         * @brief Whether a log exists, so a response can be refused before its body starts.
+         * @param file "full" (or empty) for the current log, or the number N of "/Old logs/log_N.txt".
+         */
+        bool hasLog(const char* file);
+
+        /**
+         * @brief Path of a log on the SD card, e.g. "/Old logs/log_3.txt" for file "3".
+         * @param file "full" (or empty) for the current log, or the number N of "/Old logs/log_N.txt".
+         * @return False if file is neither.
+         */
+        bool getLogPath(const char* file, char* path, size_t size);
+
+        /**
+         * @brief Numbers of the oldest and newest archives kept in "/Old logs"; last < first if
+         *        there are none yet.
+         */
+        void getArchiveRange(uint32_t &first, uint32_t &last) const;
+
+        /**
+         * @brief Heap allocations the logging task made while handling the most recent line.
+         *        Stays 0 in steady state; only meaningful with the heap allocation counter built in.
+         */
+        uint32_t getLastLineAllocations() const { return _lastLineAllocations; }
+
         /**
          * @brief Updates the `index.html` file with the latest logs.
-         * @param logFileMutex Semaphore to protect the log file access.
-         * @param logHTMLFileMutex Semaphore to protect the HTML file access.
          */
-        void updateHtmlLog(SemaphoreHandle_t &logFileMutex, SemaphoreHandle_t &logHTMLFileMutex);
+        void updateHtmlLog();
 
     private:
-        int _SD_CS;       /**< SD card chip-select pin */
-        int _SD_MISO;     /**< SD card MISO pin */
-        int _SD_MOSI;     /**< SD card MOSI pin */
-        int _SD_SCK;      /**< SD card SCK pin */
-        String _logFileName; /**< Log file name on the SD card */
+        StorageLib* _storage;  /**< Storage that owns the SD card */
+        char _logFileName[32]; /**< Log file path on the SD card */
 
         QueueHandle_t logQueue; /**< Queue to hold log messages for logging task */
 
+        /** @brief One queued message; formatted into a line by the logging task. */
+        struct LogEntry {
+            unsigned long time;          /**< EssentialsLib::getElapsedTime() when logged */
+            LogLevel level;              /**< Severity */
+            char tag[LOGGER_TAG_SIZE];   /**< Component tag */
+            char text[LOG_MESSAGE_SIZE]; /**< Message body */
+        };
+
+        File _logFile;       /**< Log file, kept open so appending a line does not allocate */
+        File _latestLogFile; /**< latest.log, kept open and rewritten in place; reopened to shrink it */
+        size_t _latestLogSize = 0; /**< Bytes in latest.log */
+        File _indexFile;           /**< Time index of the log file: (time, offset) pairs, see LOGGER_INDEX_INTERVAL */
+        size_t _logFileSize = 0;   /**< Bytes in the current log file */
+        size_t _nextIndexOffset = 0; /**< Log size at which the next index entry is due */
+        unsigned long _logFileOpened = 0; /**< getElapsedTime() when the current log file was started */
+        uint32_t _nextArchive = 1;   /**< Number the next archive will get, "/Old logs/log_N.txt" */
+        uint32_t _oldestArchive = 1; /**< Lowest archive number that may still exist */
+        uint64_t _archiveBytes = 0;  /**< Bytes of the archived logs from _oldestArchive on */
+        volatile uint32_t _lastLineAllocations = 0; /**< See getLastLineAllocations() */
+
+        LoggerStats _stats = {};     /**< Updated atomically from any task */
+        LoggerStats _reportedStats = {}; /**< Counters at the time of the last drop report */
+        unsigned long _lastStatsReport = 0; /**< getElapsedTime() of the last drop report */
+        LogEntry _previous = {};     /**< Last entry written, to detect repeats */
+        uint32_t _repeatCount = 0;   /**< Repeats of _previous not yet reported */
+        unsigned long _repeatTime = 0; /**< Time of the most recent repeat */
+        uint16_t _pendingLines = 0;  /**< Newest lines of the ring not yet written to the SD card */
+        uint32_t _pendingSince = 0;  /**< millis() when the oldest of them was logged */
+        bool _deferring = false;     /**< The pending batch is being held back for higher-priority traffic */
+
+        /** @brief Runtime threshold of one tag. */
+        struct TagLevel {
+            char tag[LOGGER_TAG_SIZE];
+            volatile uint8_t level;
+        };
+
+        TagLevel _tagLevels[LOGGER_MAX_TAGS]; /**< Tags with their own threshold */
+        volatile uint8_t _tagCount = 0;       /**< Used entries in _tagLevels */
+        volatile uint8_t _defaultLevel = LOGGER_DEFAULT_LEVEL; /**< Threshold for tags not in the table */
+
+        /**
+         * @brief Finds a tag in the level table.
+         * @return Index of the tag, or -1.
+         */
+        int _findTag(const char* tag) const;
+
         /**
          * @brief Initializes the SD card and sets up logging files.
          * @return True if the SD card was initialized successfully, false otherwise.
@@ -74,23 +364,127 @@ class LoggerLib {
         bool _initializeSD();
 
         /**
-         * @brief Writes a message to the SD card.
-         * @param message The message to write.
-         * @param sdMutex Semaphore for SD card access control.
+         * @brief Loads the archive numbering from the state file. Without one (first boot after
+         *        upgrading) it scans /Old logs once and writes the state file.
+         */
+        void _loadRotationState();
+
+        /**
+         * @brief Persists the archive numbering to the state file.
+         */
+        void _saveRotationState();
+
+        /**
+         * @brief Adds up the sizes of the archived logs; only needed when the state file has no total.
+         */
+        void _countArchiveBytes();
+
+        /**
+         * @brief Deletes the oldest archives while there are more than LOGGER_RETENTION_COUNT, they
+         *        hold more than LOGGER_RETENTION_BYTES, or the card has less than LOGGER_MIN_FREE_BYTES free.
+         */
+        void _pruneArchives();
+
+        /**
+         * @brief Moves the log file into /Old logs by renaming it, then prunes old archives with
+         *        _pruneArchives(). The log file must be closed.
+         * @return True if the log file was archived.
+         */
+        bool _archiveLogFile();
+
+        /**
+         * @brief Archives the open log file and starts a new one. Called with the storage lock held.
+         */
+        void _rotate();
+
+        /**
+         * @brief Opens the log file and its time index.
+         * @param append Keep the existing log instead of starting an empty one.
+         * @param keepIndex Keep the existing index too; false when a new boot appends, as times restart.
+         */
+        void _openLogFile(bool append, bool keepIndex);
+
+        /**
+         * @brief Appends a line to the open log file, adding a time index entry when one is due.
+         * @param line The line to write.
+         * @param length Length of the line.
+         * @param time Time the line was logged, as in its timestamp.
+         */
+        void _appendLine(const char* line, size_t length, unsigned long time);
+
+        /**
+         * @brief Builds the path of an archive, "/Old logs/log_N.<extension>".
+         */
+        static void _archivePath(char* path, size_t size, uint32_t number, const char* extension);
+
+        /**
+         * @brief Builds the path of the time index that belongs to a log file.
+         */
+        static void _indexPath(char* path, size_t size, const char* logPath);
+
+        /**
+         * @brief Resolves "full" or an archive number N to the paths of the log and its time index.
+         * @return False if file is neither.
+         */
+        bool _resolveLogFile(const char* file, char* logPath, char* indexPath, size_t size);
+
+        /**
+         * @brief Queues an entry for the logging task.
+         * @param entry Entry to copy into the queue.
+         */
+        void _enqueue(const LogEntry &entry);
+
+        /**
+         * @brief Writes an entry to Serial and the ring; it reaches the SD card with the next batch.
+         */
+        void _writeEntry(const LogEntry &entry);
+
+        /**
+         * @brief Writes "Last message repeated N times" if repeats are pending.
+         */
+        void _flushRepeats();
+
+        /**
+         * @brief Logs how many lines were dropped since the last report, at most once per
+         *        LOGGER_STATS_INTERVAL_MS and only if anything was dropped.
+         */
+        void _reportDrops();
+
+        /**
+         * @brief Formats a queued entry into a "[timestamp] [L] [TAG] message" line.
+         * @param entry Entry to format.
+         * @param line Destination buffer of LOG_LINE_SIZE bytes.
+         * @return Length of the line.
+         */
+        size_t _formatLine(const LogEntry &entry, char* line);
+
+        /**
+         * @brief Writes the pending lines to the log file and rewrites latest.log, in one go.
+         *        Held back while a higher class uses the card, unless `force` is set, the batch
+         *        holds LOGGER_BATCH_LINES lines or its oldest line is LOGGER_BATCH_MAX_DELAY_MS old.
+         */
+        void _writePendingToSD(bool force);
+
+        /**
+         * @brief Appends a line to the log file on the SD card. Called with the storage lock held.
+         * @param line The line to write.
+         * @param length Length of the line.
+         * @param time Time the line was logged.
          */
-        void _writeToSD(String message, SemaphoreHandle_t &sdMutex);
+        void _writeToSD(const char* line, size_t length, unsigned long time);
 
         /**
          * @brief Writes the latest circular buffer log to a separate file.
-         * @param logFileMutex Semaphore for log file access control.
+         * @return Bytes written.
          */
-        void _writeLatestLogToSD(SemaphoreHandle_t &logFileMutex);
+        size_t _writeLatestLogToSD();
 
         /**
-         * @brief Outputs a message to the Serial monitor.
-         * @param message The message to print to Serial.
+         * @brief Outputs a line to the Serial monitor.
+         * @param line The line to print to Serial.
+         * @param length Length of the line.
          */
-        void _writeToSerial(String message);
+        void _writeToSerial(const char* line, size_t length);
 };
 
 #endif // LOGGER_LIB
@@ -0,0 +1,136 @@
+/**
+ * @file MetricsLib.cpp
+ * @brief Implementation of the MetricsLib, MetricsHistogram and MetricsCounter classes.
+ */
+
+#include "MetricsLib.h"
+#include <esp_heap_caps.h>
+
+// CPU time needs the FreeRTOS run-time statistics, which env:stable enables through sdkconfig.defaults
+#if configGENERATE_RUN_TIME_STATS == 1 && configUSE_TRACE_FACILITY == 1
+#define METRICS_RUN_TIME_STATS 1
+#define METRICS_MAX_SYSTEM_TASKS 16 // Tasks reported from the FreeRTOS run-time counters
+static TaskStatus_t systemTasks[METRICS_MAX_SYSTEM_TASKS];
+#endif
+
+const uint32_t MetricsHistogram::bounds[METRICS_LATENCY_BUCKETS] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 50000, 100000, 500000, 1000000, 10000000
+};
+
+// Registered tasks; a slot is claimed once and never released, like the heap allocation counters
+static TaskHandle_t metricsTasks[METRICS_MAX_TASKS] = {};
+static const char* metricsTaskNames[METRICS_MAX_TASKS] = {};
+static MetricsCounter metricsTaskBusy[METRICS_MAX_TASKS];
+static portMUX_TYPE metricsTaskMux = portMUX_INITIALIZER_UNLOCKED;
+
+void MetricsHistogram::observe(uint32_t micros) {
+    int bucket = 0;
+    while (bucket < METRICS_LATENCY_BUCKETS && micros > bounds[bucket]) {
+        bucket++;
+    }
+    __atomic_fetch_add(&_buckets[bucket], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&_count, 1, __ATOMIC_RELAXED);
+    _sum.add(micros);
+}
+
+void MetricsHistogram::print(Print &out, const char* name, const char* labels) const {
+    const char* separator = labels ? "," : "";
+    if (!labels) labels = "";
+
+    unsigned long cumulative = 0;
+    for (int i = 0; i <= METRICS_LATENCY_BUCKETS; i++) {
+        cumulative += __atomic_load_n(&_buckets[i], __ATOMIC_RELAXED);
+        if (i < METRICS_LATENCY_BUCKETS) {
+            out.printf(METRICS_PREFIX "%s_bucket{%s%sle=\"%g\"} %lu\n", name, labels, separator, bounds[i] / 1e6, cumulative);
+        } else {
+            out.printf(METRICS_PREFIX "%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, separator, cumulative);
+        }
+    }
+
+    const char* open = labels[0] ? "{" : "";
+    const char* close = labels[0] ? "}" : "";
+    uint64_t sum = _sum.value();
+    out.printf(METRICS_PREFIX "%s_sum%s%s%s %lu.%06lu\n", name, open, labels, close, (unsigned long)(sum / 1000000), (unsigned long)(sum % 1000000));
+    out.printf(METRICS_PREFIX "%s_count%s%s%s %lu\n", name, open, labels, close, (unsigned long)count());
+}
+
+bool MetricsLib::registerTask(const char* name) {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    bool registered = false;
+    portENTER_CRITICAL(&metricsTaskMux);
+    for (int i = 0; i < METRICS_MAX_TASKS && !registered; i++) {
+        if (metricsTasks[i] == self || metricsTasks[i] == nullptr) {
+            metricsTaskNames[i] = name;
+            metricsTasks[i] = self;
+            registered = true;
+        }
+    }
+    portEXIT_CRITICAL(&metricsTaskMux);
+    return registered;
+}
+
+void MetricsLib::addTaskBusyTime(uint32_t micros) {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < METRICS_MAX_TASKS; i++) {
+        if (metricsTasks[i] == self) {
+            metricsTaskBusy[i].add(micros);
+            return;
+        }
+    }
+}
+
+void MetricsLib::printHeader(Print &out, const char* name, const char* type, const char* help) {
+    out.printf("# HELP " METRICS_PREFIX "%s %s\n", name, help);
+    out.printf("# TYPE " METRICS_PREFIX "%s %s\n", name, type);
+}
+
+void MetricsLib::printValue(Print &out, const char* name, const char* type, const char* help, uint64_t value) {
+    printHeader(out, name, type, help);
+    out.printf(METRICS_PREFIX "%s %llu\n", name, (unsigned long long)value);
+}
+
+void MetricsLib::printSystemMetrics(Print &out) {
+    unsigned long uptime = millis();
+    printHeader(out, "uptime_seconds", "gauge", "Time since reset.");
+    out.printf(METRICS_PREFIX "uptime_seconds %lu.%03lu\n", uptime / 1000, uptime % 1000);
+
+    // Heap, internal RAM and PSRAM separately
+    static const struct { const char* name; uint32_t caps; } regions[] = {
+        {"internal", MALLOC_CAP_INTERNAL}, {"psram", MALLOC_CAP_SPIRAM}
+    };
+    printHeader(out, "heap_free_bytes", "gauge", "Free heap.");
+    for (const auto &region : regions) {
+        out.printf(METRICS_PREFIX "heap_free_bytes{region=\"%s\"} %lu\n", region.name, (unsigned long)heap_caps_get_free_size(region.caps));
+    }
+    printHeader(out, "heap_min_free_bytes", "gauge", "Lowest free heap since reset.");
+    for (const auto &region : regions) {
+        out.printf(METRICS_PREFIX "heap_min_free_bytes{region=\"%s\"} %lu\n", region.name, (unsigned long)heap_caps_get_minimum_free_size(region.caps));
+    }
+    printHeader(out, "heap_largest_free_block_bytes", "gauge", "Largest block that can be allocated at once.");
+    for (const auto &region : regions) {
+        out.printf(METRICS_PREFIX "heap_largest_free_block_bytes{region=\"%s\"} %lu\n", region.name, (unsigned long)heap_caps_get_largest_free_block(region.caps));
+    }
+
+    // Registered tasks: stack headroom and busy time; the busy share is rate() of the counter
+    printHeader(out, "task_stack_free_bytes", "gauge", "Lowest free stack the task has had (high-water mark).");
+    for (int i = 0; i < METRICS_MAX_TASKS && metricsTasks[i]; i++) {
+        out.printf(METRICS_PREFIX "task_stack_free_bytes{task=\"%s\"} %lu\n", metricsTaskNames[i], (unsigned long)uxTaskGetStackHighWaterMark(metricsTasks[i]));
+    }
+    printHeader(out, "task_busy_seconds_total", "counter", "Wall time the task spent handling work rather than idle, including waits for the SD card lock and the network; not CPU time.");
+    for (int i = 0; i < METRICS_MAX_TASKS && metricsTasks[i]; i++) {
+        uint64_t busy = metricsTaskBusy[i].value();
+        out.printf(METRICS_PREFIX "task_busy_seconds_total{task=\"%s\"} %lu.%06lu\n", metricsTaskNames[i], (unsigned long)(busy / 1000000), (unsigned long)(busy % 1000000));
+    }
+
+#ifdef METRICS_RUN_TIME_STATS
+    // CPU time of every task, from the FreeRTOS run-time counters (microseconds on the ESP32); the
+    // 32-bit counters wrap after about 71 minutes, which rate() handles as a counter reset
+    uint32_t totalRunTime;
+    UBaseType_t count = uxTaskGetSystemState(systemTasks, METRICS_MAX_SYSTEM_TASKS, &totalRunTime);
+    printHeader(out, "task_cpu_seconds_total", "counter", "CPU time of every task, from the FreeRTOS run-time statistics; rate() gives its share of one core.");
+    for (UBaseType_t i = 0; i < count; i++) {
+        unsigned long runTime = systemTasks[i].ulRunTimeCounter;
+        out.printf(METRICS_PREFIX "task_cpu_seconds_total{task=\"%s\"} %lu.%06lu\n", systemTasks[i].pcTaskName, runTime / 1000000, runTime % 1000000);
+    }
+#endif
+}
@@ -0,0 +1,123 @@
+/**
+ * @file MetricsLib.h
+ * @brief Metrics library: lock-free counters and latency histograms, task and heap metrics,
+ *        and helpers for writing them in the Prometheus text exposition format.
+ */
+
+#ifndef METRICS_LIB
+#define METRICS_LIB
+
+#include <Arduino.h>
+
+#define METRICS_MAX_TASKS 4          /**< Tasks that can register for busy-time and stack metrics */
+#define METRICS_LATENCY_BUCKETS 12   /**< Finite buckets of a MetricsHistogram */
+#define METRICS_PREFIX "multilauncher_" /**< Prefix of every metric name */
+
+/**
+ * @class MetricsCounter
+ * @brief A 64-bit counter built from two 32-bit words, so updates are single lock-free atomic
+ *        adds on the ESP32 (which has no native 64-bit atomics). The carry is added separately,
+ *        so a concurrent read may briefly be off by 2^32; values are only read for reporting.
+ */
+class MetricsCounter {
+    public:
+        /**
+         * @brief Adds to the counter. Safe from any task on either core.
+         */
+        void add(uint32_t amount) {
+            uint32_t previous = __atomic_fetch_add(&_low, amount, __ATOMIC_RELAXED);
+            if ((uint32_t)(previous + amount) < previous) {
+                __atomic_fetch_add(&_high, 1, __ATOMIC_RELAXED);
+            }
+        }
+
+        /**
+         * @brief Current value.
+         */
+        uint64_t value() const {
+            return ((uint64_t)__atomic_load_n(&_high, __ATOMIC_RELAXED) << 32) | __atomic_load_n(&_low, __ATOMIC_RELAXED);
+        }
+
+    private:
+        uint32_t _low = 0;  /**< Low word */
+        uint32_t _high = 0; /**< Carries out of the low word */
+};
+
+/**
+ * @class MetricsHistogram
+ * @brief Latency histogram with fixed buckets from 100 us to 10 s. Observing is one atomic add
+ *        per bucket, count and sum; the cumulative Prometheus buckets are built when printed.
+ */
+class MetricsHistogram {
+    public:
+        /**
+         * @brief Records one observation.
+         * @param micros Latency in microseconds.
+         */
+        void observe(uint32_t micros);
+
+        /**
+         * @brief Number of observations.
+         */
+        uint32_t count() const { return __atomic_load_n(&_count, __ATOMIC_RELAXED); }
+
+        /**
+         * @brief Writes the _bucket, _sum and _count series of the histogram, in seconds.
+         * @param out Destination.
+         * @param name Metric name without prefix.
+         * @param labels Labels without braces, e.g. "route=\"/boot\"", or nullptr.
+         */
+        void print(Print &out, const char* name, const char* labels = nullptr) const;
+
+        /**
+         * @brief Upper bounds of the finite buckets, in microseconds.
+         */
+        static const uint32_t bounds[METRICS_LATENCY_BUCKETS];
+
+    private:
+        uint32_t _buckets[METRICS_LATENCY_BUCKETS + 1] = {}; /**< Observations per bucket, last one is +Inf */
+        uint32_t _count = 0;                                 /**< Observations */
+        MetricsCounter _sum;                                 /**< Sum of the observations in microseconds */
+};
+
+/**
+ * @class MetricsLib
+ * @brief Task and heap metrics, and the Prometheus formatting shared by every library.
+ */
+class MetricsLib {
+    public:
+        /**
+         * @brief Registers the calling task for busy-time and stack metrics.
+         * @param name Label of the task in the metrics; must outlive the task.
+         * @return False if all METRICS_MAX_TASKS slots are in use.
+         */
+        static bool registerTask(const char* name);
+
+        /**
+         * @brief Adds wall time the calling task spent handling work rather than idle; unregistered
+         *        tasks are ignored. Blocking waits inside that work (the SD card lock, the socket)
+         *        count too, so this is a busy time, not CPU time.
+         * @param micros Busy time in microseconds.
+         */
+        static void addTaskBusyTime(uint32_t micros);
+
+        /**
+         * @brief Writes the "# HELP" and "# TYPE" lines of a metric family.
+         * @param type "counter", "gauge" or "histogram".
+         */
+        static void printHeader(Print &out, const char* name, const char* type, const char* help);
+
+        /**
+         * @brief Writes a single-sample gauge or counter family, header included.
+         */
+        static void printValue(Print &out, const char* name, const char* type, const char* help, uint64_t value);
+
+        /**
+         * @brief Writes uptime, heap (internal and PSRAM) and task metrics. Task times are counters,
+         *        so the output does not depend on when or how often it is scraped; CPU time needs
+         *        the FreeRTOS run-time statistics (configGENERATE_RUN_TIME_STATS).
+         */
+        static void printSystemMetrics(Print &out);
+};
+
+#endif // METRICS_LIB
@@ -0,0 +1,383 @@
+/**
+ * @file StorageLib.cpp
+ * @brief Implementation of the StorageLib class.
+ */
+
+#include "StorageLib.h"
+#include <TraceLib.h>
+
+#define BENCHMARK_FILE "/.storage-bench.tmp"
+
+StorageLib::StorageLib(int SD_CS, int SD_MISO, int SD_MOSI, int SD_SCK)
+    : _SD_CS(SD_CS), _SD_MISO(SD_MISO), _SD_MOSI(SD_MOSI), _SD_SCK(SD_SCK) {
+    _state = xSemaphoreCreateMutex();
+    for (int i = 0; i < STORAGE_MAX_WAITERS; i++) {
+        _waiters[i].wake = xSemaphoreCreateBinary();
+    }
+}
+
+void StorageLib::setBusMode(StorageBusMode mode) {
+    if (!_mounted) _mode = mode;
+}
+
+void StorageLib::setFrequency(uint32_t frequencyKhz) {
+    if (!_mounted) _frequencyKhz = frequencyKhz;
+}
+
+void StorageLib::setSdmmcPins(int clk, int cmd, int d0, int d1, int d2, int d3) {
+    if (_mounted) return;
+    _sdmmcPins[0] = clk;
+    _sdmmcPins[1] = cmd;
+    _sdmmcPins[2] = d0;
+    _sdmmcPins[3] = d1;
+    _sdmmcPins[4] = d2;
+    _sdmmcPins[5] = d3;
+}
+
+bool StorageLib::begin() {
+    StorageLock lock(this);
+    if (_mounted) return true;
+
+    if (_mode == STORAGE_BUS_SPI) {
+        SPI.begin(_SD_SCK, _SD_MISO, _SD_MOSI, _SD_CS);
+        uint32_t frequency = _frequencyKhz ? _frequencyKhz * 1000 : 4000000;
+        _mounted = SD.begin(_SD_CS, SPI, frequency, "/sd", STORAGE_MAX_OPEN_FILES);
+    } else {
+        if (_mode == STORAGE_BUS_SDMMC_4BIT && (_sdmmcPins[3] < 0 || _sdmmcPins[4] < 0 || _sdmmcPins[5] < 0)) {
+            Serial.println("SD card: D1-D3 not wired, using SDMMC 1-bit mode");
+            _mode = STORAGE_BUS_SDMMC_1BIT;
+        }
+        bool oneBit = _mode == STORAGE_BUS_SDMMC_1BIT;
+        bool pinsSet = oneBit
+            ? SD_MMC.setPins(_sdmmcPins[0], _sdmmcPins[1], _sdmmcPins[2])
+            : SD_MMC.setPins(_sdmmcPins[0], _sdmmcPins[1], _sdmmcPins[2], _sdmmcPins[3], _sdmmcPins[4], _sdmmcPins[5]);
+        int frequency = _frequencyKhz ? (int)_frequencyKhz : SDMMC_FREQ_DEFAULT;
+        _mounted = pinsSet && SD_MMC.begin("/sdcard", oneBit, false, frequency, STORAGE_MAX_OPEN_FILES);
+    }
+
+    if (!_mounted) {
+        Serial.printf("SD card mount failed (%s)\n", busModeName(_mode));
+    }
+    return _mounted;
+}
+
+fs::FS &StorageLib::fs() {
+    if (_mode == STORAGE_BUS_SPI) return SD;
+    return SD_MMC;
+}
+
+bool StorageLib::lock(StorageIoClass ioClass, TickType_t wait) {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    uint32_t start = micros();
+    TickType_t startTick = xTaskGetTickCount();
+    int slot = -1;
+
+    while (slot < 0) {
+        xSemaphoreTake(_state, portMAX_DELAY);
+        if (_owner == self) {
+            _depth++;
+            xSemaphoreGive(_state);
+            return true;
+        }
+
+        bool queued = false;
+        for (int i = 0; i < STORAGE_MAX_WAITERS && !queued; i++) {
+            queued = _waiters[i].used;
+        }
+        if (_owner == nullptr && !queued) {
+            _owner = self;
+            _depth = 1;
+            _ownerClass = ioClass;
+            _recordGrant(ioClass, micros() - start, false, false);
+            xSemaphoreGive(_state);
+            return true;
+        }
+
+        TickType_t waited = xTaskGetTickCount() - startTick;
+        if (wait != portMAX_DELAY && waited >= wait) {
+            xSemaphoreGive(_state);
+            return false;
+        }
+        for (int i = 0; i < STORAGE_MAX_WAITERS && slot < 0; i++) {
+            if (!_waiters[i].used) slot = i;
+        }
+        if (slot < 0) {
+            // Every slot is taken: retry shortly rather than fail
+            xSemaphoreGive(_state);
+            vTaskDelay(1);
+            continue;
+        }
+
+        Waiter &waiter = _waiters[slot];
+        waiter.used = true;
+        waiter.granted = false;
+        waiter.starved = false;
+        waiter.ioClass = ioClass;
+        waiter.task = self;
+        waiter.since = millis();
+        xSemaphoreGive(_state);
+    }
+
+    // Sleep until unlock() hands the card over
+    Waiter &waiter = _waiters[slot];
+    TickType_t waited = xTaskGetTickCount() - startTick;
+    TickType_t remaining = wait == portMAX_DELAY ? portMAX_DELAY : (waited < wait ? wait - waited : 0);
+    bool woken = xSemaphoreTake(waiter.wake, remaining) == pdTRUE;
+
+    xSemaphoreTake(_state, portMAX_DELAY);
+    bool granted = waiter.granted;
+    if (granted && !woken) {
+        xSemaphoreTake(waiter.wake, 0); // Granted just as the wait timed out
+    }
+    if (granted) {
+        uint32_t waitedUs = micros() - start;
+        _recordGrant(ioClass, waitedUs, true, waiter.starved);
+        TraceLib::record("sd.wait", EssentialsLib::getMicros() - waitedUs, waitedUs);
+    }
+    waiter.used = false;
+    xSemaphoreGive(_state);
+    return granted;
+}
+
+void StorageLib::unlock() {
+    xSemaphoreTake(_state, portMAX_DELAY);
+    if (_owner == xTaskGetCurrentTaskHandle() && --_depth == 0) {
+        _lastRelease[_ownerClass] = millis();
+        _owner = nullptr;
+        _grantNext();
+    }
+    xSemaphoreGive(_state);
+}
+
+void StorageLib::_grantNext() {
+    // Oldest starved waiter first, otherwise the highest class, first come first served within it
+    uint32_t now = millis();
+    int best = -1;
+    bool bestStarved = false;
+    for (int i = 0; i < STORAGE_MAX_WAITERS; i++) {
+        Waiter &waiter = _waiters[i];
+        if (!waiter.used || waiter.granted) continue;
+
+        bool starved = now - waiter.since >= STORAGE_STARVATION_MS;
+        if (best < 0) {
+            best = i;
+            bestStarved = starved;
+            continue;
+        }
+        Waiter &current = _waiters[best];
+        bool better;
+        if (starved != bestStarved) {
+            better = starved;
+        } else if (!starved && waiter.ioClass != current.ioClass) {
+            better = waiter.ioClass > current.ioClass;
+        } else {
+            better = (int32_t)(waiter.since - current.since) < 0;
+        }
+        if (better) {
+            best = i;
+            bestStarved = starved;
+        }
+    }
+    if (best < 0) return;
+
+    Waiter &waiter = _waiters[best];
+    waiter.granted = true;
+    waiter.starved = bestStarved;
+    _owner = waiter.task;
+    _depth = 1;
+    _ownerClass = waiter.ioClass;
+    xSemaphoreGive(waiter.wake);
+}
+
+void StorageLib::_recordGrant(StorageIoClass ioClass, uint32_t waitedUs, bool contended, bool starved) {
+    StorageClassStats &stats = _classStats[ioClass];
+    stats.grants++;
+    if (contended) stats.contended++;
+    if (starved) stats.starved++;
+    stats.totalWaitUs += waitedUs;
+    if (waitedUs > stats.maxWaitUs) stats.maxWaitUs = waitedUs;
+}
+
+bool StorageLib::hasPriorityTraffic(StorageIoClass ioClass) {
+    uint32_t now = millis();
+    bool busy = false;
+    xSemaphoreTake(_state, portMAX_DELAY);
+    if (_owner != nullptr && _ownerClass > ioClass) busy = true;
+    for (int i = 0; i < STORAGE_MAX_WAITERS && !busy; i++) {
+        busy = _waiters[i].used && _waiters[i].ioClass > ioClass;
+    }
+    for (int c = ioClass + 1; c < STORAGE_IO_CLASSES && !busy; c++) {
+        busy = _classStats[c].grants > 0 && now - _lastRelease[c] < STORAGE_ACTIVE_WINDOW_MS;
+    }
+    xSemaphoreGive(_state);
+    return busy;
+}
+
+StorageClassStats StorageLib::getClassStats(StorageIoClass ioClass) {
+    xSemaphoreTake(_state, portMAX_DELAY);
+    StorageClassStats stats = _classStats[ioClass];
+    xSemaphoreGive(_state);
+    return stats;
+}
+
+void StorageLib::printStats(Print &out) {
+    for (int c = STORAGE_IO_CLASSES - 1; c >= 0; c--) {
+        StorageIoClass ioClass = (StorageIoClass)c;
+        StorageClassStats stats = getClassStats(ioClass);
+        const char* name = ioClassName(ioClass);
+        out.printf("%s.grants=%lu\n", name, (unsigned long)stats.grants);
+        out.printf("%s.contended=%lu\n", name, (unsigned long)stats.contended);
+        out.printf("%s.starved=%lu\n", name, (unsigned long)stats.starved);
+        out.printf("%s.wait_us.total=%llu\n", name, (unsigned long long)stats.totalWaitUs);
+        out.printf("%s.wait_us.max=%lu\n", name, (unsigned long)stats.maxWaitUs);
+        out.printf("%s.wait_us.mean=%lu\n", name, stats.grants ? (unsigned long)(stats.totalWaitUs / stats.grants) : 0UL);
+    }
+    out.printf("starvation_ms=%d\n", STORAGE_STARVATION_MS);
+}
+
+const char* StorageLib::ioClassName(StorageIoClass ioClass) {
+    switch (ioClass) {
+        case STORAGE_IO_FIRMWARE: return "firmware";
+        case STORAGE_IO_INTERACTIVE: return "interactive";
+        default: return "background";
+    }
+}
+
+size_t StorageLib::read(File &file, uint8_t* buffer, size_t size, StorageIoClass ioClass) {
+    TRACE_SCOPE("sd.read");
+    StorageLock lock(this, ioClass);
+    uint32_t start = micros();
+    size_t count = file.read(buffer, size);
+    recordRead(count, micros() - start);
+    return count;
+}
+
+size_t StorageLib::write(File &file, const uint8_t* buffer, size_t size, StorageIoClass ioClass) {
+    TRACE_SCOPE("sd.write");
+    StorageLock lock(this, ioClass);
+    uint32_t start = micros();
+    size_t count = file.write(buffer, size);
+    recordWrite(count, micros() - start);
+    return count;
+}
+
+void StorageLib::recordRead(size_t bytes, uint32_t micros) {
+    _readBytes.add(bytes);
+    _readLatency.observe(micros);
+}
+
+void StorageLib::recordReadBytes(size_t bytes) {
+    _readBytes.add(bytes);
+}
+
+void StorageLib::recordWrite(size_t bytes, uint32_t micros) {
+    _writtenBytes.add(bytes);
+    _writeLatency.observe(micros);
+}
+
+void StorageLib::printMetrics(Print &out) {
+    MetricsLib::printValue(out, "sd_read_bytes_total", "counter", "Bytes read from the SD card.", _readBytes.value());
+    MetricsLib::printValue(out, "sd_written_bytes_total", "counter", "Bytes written to the SD card.", _writtenBytes.value());
+    MetricsLib::printHeader(out, "sd_operation_seconds", "histogram", "Time per SD read or write operation.");
+    _readLatency.print(out, "sd_operation_seconds", "op=\"read\"");
+    _writeLatency.print(out, "sd_operation_seconds", "op=\"write\"");
+
+    StorageClassStats stats[STORAGE_IO_CLASSES];
+    for (int c = 0; c < STORAGE_IO_CLASSES; c++) {
+        stats[c] = getClassStats((StorageIoClass)c);
+    }
+    MetricsLib::printHeader(out, "sd_grants_total", "counter", "Times the SD card was granted, per priority class.");
+    for (int c = 0; c < STORAGE_IO_CLASSES; c++) {
+        out.printf(METRICS_PREFIX "sd_grants_total{class=\"%s\"} %lu\n", ioClassName((StorageIoClass)c), (unsigned long)stats[c].grants);
+    }
+    MetricsLib::printHeader(out, "sd_wait_seconds_total", "counter", "Time spent queueing for the SD card, per priority class.");
+    for (int c = 0; c < STORAGE_IO_CLASSES; c++) {
+        out.printf(METRICS_PREFIX "sd_wait_seconds_total{class=\"%s\"} %lu.%06lu\n", ioClassName((StorageIoClass)c),
+                   (unsigned long)(stats[c].totalWaitUs / 1000000), (unsigned long)(stats[c].totalWaitUs % 1000000));
+    }
+}
+
+StorageBenchmark StorageLib::benchmark(size_t bytes) {
+    StorageBenchmark result = {};
+    if (!_mounted || bytes == 0 || bytes > STORAGE_BENCHMARK_MAX_SIZE) return result;
+    TRACE_SCOPE("sd.benchmark");
+
+    uint8_t* buffer = (uint8_t*)malloc(STORAGE_BENCHMARK_CHUNK);
+    if (!buffer) return result;
+    for (size_t i = 0; i < STORAGE_BENCHMARK_CHUNK; i++) {
+        buffer[i] = (uint8_t)i;
+    }
+
+    // Held for the whole run so other tasks do not skew the numbers.
+    StorageLock lock(this);
+    fs::FS &card = fs();
+    size_t written = 0;
+    size_t readBack = 0;
+
+    uint32_t start = micros();
+    File file = card.open(BENCHMARK_FILE, FILE_WRITE);
+    if (file) {
+        while (written < bytes) {
+            size_t chunk = min((size_t)STORAGE_BENCHMARK_CHUNK, bytes - written);
+            if (file.write(buffer, chunk) != chunk) break;
+            written += chunk;
+        }
+        file.close();
+    }
+    result.writeUs = micros() - start;
+    recordWrite(written, result.writeUs);
+
+    start = micros();
+    file = card.open(BENCHMARK_FILE, FILE_READ);
+    if (file) {
+        size_t chunk;
+        while ((chunk = file.read(buffer, STORAGE_BENCHMARK_CHUNK)) > 0) {
+            readBack += chunk;
+        }
+        file.close();
+    }
+    result.readUs = micros() - start;
+    recordRead(readBack, result.readUs);
+
+    card.remove(BENCHMARK_FILE);
+    free(buffer);
+
+    result.ok = written == bytes && readBack == bytes;
+    result.bytes = written;
+    if (result.writeUs) result.writeMBps = (float)written / result.writeUs;
+    if (result.readUs) result.readMBps = (float)readBack / result.readUs;
+    return result;
+}
+
+const char* StorageLib::busModeName(StorageBusMode mode) {
+    switch (mode) {
+        case STORAGE_BUS_SDMMC_1BIT: return "sdmmc-1bit";
+        case STORAGE_BUS_SDMMC_4BIT: return "sdmmc-4bit";
+        default: return "spi";
+    }
+}
+
+uint64_t StorageLib::getFreeBytes() {
+    if (!_mounted) return 0;
+
+    StorageLock lock(this);
+    if (_mode == STORAGE_BUS_SPI) {
+        return SD.totalBytes() - SD.usedBytes();
+    }
+    return SD_MMC.totalBytes() - SD_MMC.usedBytes();
+}
+
+void StorageLib::printInfo(Print &out) {
+    out.printf("mounted=%d\n", _mounted ? 1 : 0);
+    out.printf("bus=%s\n", busModeName(_mode));
+    out.printf("frequency_khz=%lu\n", (unsigned long)_frequencyKhz);
+    if (!_mounted) return;
+
+    StorageLock lock(this);
+    sdcard_type_t type = _mode == STORAGE_BUS_SPI ? SD.cardType() : SD_MMC.cardType();
+    uint64_t size = _mode == STORAGE_BUS_SPI ? SD.cardSize() : SD_MMC.cardSize();
+    const char* typeName = type == CARD_MMC ? "MMC" : type == CARD_SD ? "SDSC" : type == CARD_SDHC ? "SDHC" : "UNKNOWN";
+    out.printf("card_type=%s\n", typeName);
+    out.printf("card_size_mb=%lu\n", (unsigned long)(size / (1024 * 1024)));
+    out.printf("card_free_mb=%lu\n", (unsigned long)(getFreeBytes() / (1024 * 1024)));
+}
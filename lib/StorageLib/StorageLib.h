@@ -0,0 +1,297 @@
+/**
+ * @file StorageLib.h
+ * @brief Storage library that mounts the SD card once, over SPI or SDMMC, and schedules
+ *        access to it between tasks by priority class.
+ */
+
+#ifndef STORAGE_LIB
+#define STORAGE_LIB
+
+#include <Arduino.h>
+#include <FS.h>
+#include <SPI.h>
+#include <SD.h>
+#include <SD_MMC.h>
+#include "MetricsLib.h"
+
+#define STORAGE_MAX_OPEN_FILES 10           /**< Files open at once: the logger alone keeps three open */
+#define STORAGE_BENCHMARK_SIZE (1024 * 1024) /**< Bytes written and read back by benchmark() */
+#define STORAGE_BENCHMARK_CHUNK 4096        /**< Transfer size used by benchmark() */
+#define STORAGE_BENCHMARK_MAX_SIZE (4 * 1024 * 1024) /**< Largest test file; the card is locked for the whole run */
+#define STORAGE_MAX_WAITERS 8               /**< Tasks that can queue for the card at once */
+
+#ifndef STORAGE_STARVATION_MS
+#define STORAGE_STARVATION_MS 500 /**< A request waiting this long is served next, whatever its class */
+#endif
+
+#ifndef STORAGE_ACTIVE_WINDOW_MS
+#define STORAGE_ACTIVE_WINDOW_MS 100 /**< A class counts as active for this long after it releases the card */
+#endif
+
+/**
+ * @brief How the SD card is connected.
+ */
+enum StorageBusMode : uint8_t {
+    STORAGE_BUS_SPI = 0,    /**< SPI through the SD library (CS/MISO/MOSI/SCK) */
+    STORAGE_BUS_SDMMC_1BIT, /**< SDMMC host, CLK/CMD/D0 */
+    STORAGE_BUS_SDMMC_4BIT  /**< SDMMC host, CLK/CMD/D0-D3 */
+};
+
+/**
+ * @brief Priority classes for access to the card; when it is released, the highest waiting class gets it.
+ */
+enum StorageIoClass : uint8_t {
+    STORAGE_IO_BACKGROUND = 0, /**< Logging */
+    STORAGE_IO_INTERACTIVE,    /**< Serving HTTP requests */
+    STORAGE_IO_FIRMWARE,       /**< Streaming a firmware image */
+    STORAGE_IO_CLASSES         /**< Number of classes */
+};
+
+/**
+ * @brief Per-class counters of the card scheduler.
+ */
+struct StorageClassStats {
+    uint32_t grants;      /**< Times the card was granted to the class */
+    uint32_t contended;   /**< Grants that had to queue behind another task */
+    uint32_t starved;     /**< Grants that hit STORAGE_STARVATION_MS and skipped the priority order */
+    uint32_t maxWaitUs;   /**< Longest time spent queueing */
+    uint64_t totalWaitUs; /**< Total time spent queueing */
+};
+
+/**
+ * @brief Result of StorageLib::benchmark().
+ */
+struct StorageBenchmark {
+    bool ok;           /**< False if the test file could not be written or read back */
+    size_t bytes;      /**< Bytes written and read */
+    uint32_t writeUs;  /**< Time to write and flush them */
+    uint32_t readUs;   /**< Time to read them back */
+    float writeMBps;   /**< Write throughput in MB/s */
+    float readMBps;    /**< Read throughput in MB/s */
+};
+
+/**
+ * @class StorageLib
+ * @brief Owns the SD card: mounts it once with the configured bus and clock, and serialises
+ *        access with a recursive lock so multi-step operations are not interleaved.
+ *        The lock is granted by priority class (firmware > interactive > background), FIFO within
+ *        a class, with requests older than STORAGE_STARVATION_MS served first.
+ *        Nothing touches the hardware before begin(), so instances can be global.
+ */
+class StorageLib {
+    public:
+        /**
+         * @brief Constructs a StorageLib instance for an SD card on SPI (the default bus).
+         * @param SD_CS SD card chip-select pin.
+         * @param SD_MISO SD card MISO pin.
+         * @param SD_MOSI SD card MOSI pin.
+         * @param SD_SCK SD card SCK pin.
+         */
+        StorageLib(int SD_CS = 5, int SD_MISO = 2, int SD_MOSI = 19, int SD_SCK = 18);
+
+        /**
+         * @brief Selects the bus. Must be called before begin().
+         * @param mode SPI, or SDMMC in 1- or 4-bit mode. 4-bit falls back to 1-bit if D1/D2 are not set.
+         */
+        void setBusMode(StorageBusMode mode);
+
+        /**
+         * @brief Sets the bus clock. Must be called before begin().
+         * @param frequencyKhz Clock in kHz; 0 keeps the library default (4 MHz on SPI, 20 MHz on SDMMC).
+         */
+        void setFrequency(uint32_t frequencyKhz);
+
+        /**
+         * @brief Sets the SDMMC pins (any GPIO on the ESP32-S3). Must be called before begin().
+         *        Pass -1 for data lines that are not wired.
+         */
+        void setSdmmcPins(int clk, int cmd, int d0, int d1 = -1, int d2 = -1, int d3 = -1);
+
+        /**
+         * @brief Mounts the card. Safe to call more than once; only the first call touches the bus.
+         * @return True if the card is mounted.
+         */
+        bool begin();
+
+        /**
+         * @brief Whether begin() succeeded.
+         */
+        bool isMounted() const { return _mounted; }
+
+        /**
+         * @brief The mounted filesystem. Hold a StorageLock while using it.
+         */
+        fs::FS &fs();
+
+        /**
+         * @brief Takes the bus lock. Recursive, so a holder may call code that locks again;
+         *        nested calls keep the class of the outermost one.
+         * @param ioClass Priority class of the caller.
+         * @param wait Ticks to wait for the lock.
+         * @return True if the lock was taken.
+         */
+        bool lock(StorageIoClass ioClass = STORAGE_IO_INTERACTIVE, TickType_t wait = portMAX_DELAY);
+
+        /**
+         * @brief Releases the bus lock and hands it to the next waiter.
+         */
+        void unlock();
+
+        /**
+         * @brief Whether a class above ioClass holds the card, is queueing for it or released it
+         *        less than STORAGE_ACTIVE_WINDOW_MS ago. Low-priority work uses this to defer itself.
+         */
+        bool hasPriorityTraffic(StorageIoClass ioClass);
+
+        /**
+         * @brief Reads from a file under the bus lock, so streaming a file to a slow client only
+         *        holds the bus for one chunk at a time.
+         * @return Bytes read.
+         */
+        size_t read(File &file, uint8_t* buffer, size_t size, StorageIoClass ioClass = STORAGE_IO_INTERACTIVE);
+
+        /**
+         * @brief Writes to a file under the bus lock.
+         * @return Bytes written.
+         */
+        size_t write(File &file, const uint8_t* buffer, size_t size, StorageIoClass ioClass = STORAGE_IO_INTERACTIVE);
+
+        /**
+         * @brief Counts data read from the card by code that does not go through read().
+         * @param bytes Bytes read.
+         * @param micros Time the transfer took.
+         */
+        void recordRead(size_t bytes, uint32_t micros);
+
+        /**
+         * @brief Counts bytes read from the card by a long stream that is not one SD operation,
+         *        e.g. a firmware update, without putting its duration in the read latency histogram.
+         * @param bytes Bytes read.
+         */
+        void recordReadBytes(size_t bytes);
+
+        /**
+         * @brief Counts data written to the card by code that does not go through write().
+         * @param bytes Bytes written.
+         * @param micros Time the transfer took.
+         */
+        void recordWrite(size_t bytes, uint32_t micros);
+
+        /**
+         * @brief Writes the SD transfer and scheduler metrics in the Prometheus text format.
+         */
+        void printMetrics(Print &out);
+
+        /**
+         * @brief Returns a copy of the scheduler counters of a class.
+         */
+        StorageClassStats getClassStats(StorageIoClass ioClass);
+
+        /**
+         * @brief Writes the scheduler counters of every class as "name=value" lines.
+         */
+        void printStats(Print &out);
+
+        /**
+         * @brief Returns "background", "interactive" or "firmware".
+         */
+        static const char* ioClassName(StorageIoClass ioClass);
+
+        /**
+         * @brief Writes and reads back a test file to measure the throughput of the current bus.
+         *        Holds the card for the whole run, so the logger cannot write and drops lines once
+         *        its queue is full.
+         * @param bytes Size of the test file, at most STORAGE_BENCHMARK_MAX_SIZE.
+         */
+        StorageBenchmark benchmark(size_t bytes = STORAGE_BENCHMARK_SIZE);
+
+        /**
+         * @brief The bus actually in use (after any 4-bit to 1-bit fallback).
+         */
+        StorageBusMode getBusMode() const { return _mode; }
+
+        /**
+         * @brief The configured bus clock in kHz, 0 for the library default.
+         */
+        uint32_t getFrequency() const { return _frequencyKhz; }
+
+        /**
+         * @brief Free space on the card, 0 if it is not mounted. The first call after mounting
+         *        may scan the FAT, so call it when a rotation happens rather than per line.
+         */
+        uint64_t getFreeBytes();
+
+        /**
+         * @brief Returns "spi", "sdmmc-1bit" or "sdmmc-4bit".
+         */
+        static const char* busModeName(StorageBusMode mode);
+
+        /**
+         * @brief Writes the bus, clock and card details as "name=value" lines.
+         */
+        void printInfo(Print &out);
+
+    private:
+        int _SD_CS;       /**< SD card chip-select pin */
+        int _SD_MISO;     /**< SD card MISO pin */
+        int _SD_MOSI;     /**< SD card MOSI pin */
+        int _SD_SCK;      /**< SD card SCK pin */
+        int _sdmmcPins[6] = {-1, -1, -1, -1, -1, -1}; /**< CLK, CMD, D0, D1, D2, D3 */
+
+        StorageBusMode _mode = STORAGE_BUS_SPI; /**< Bus in use */
+        uint32_t _frequencyKhz = 0;             /**< Bus clock, 0 for the library default */
+        bool _mounted = false;                  /**< Set once begin() succeeded */
+
+        /**
+         * @brief A task queueing for the card.
+         */
+        struct Waiter {
+            bool used;                /**< Slot is taken */
+            bool granted;             /**< Card has been handed to this waiter */
+            bool starved;             /**< Granted because it hit STORAGE_STARVATION_MS */
+            StorageIoClass ioClass;   /**< Class it asked for */
+            TaskHandle_t task;        /**< Waiting task */
+            uint32_t since;           /**< millis() when it started waiting */
+            SemaphoreHandle_t wake;   /**< Given when the card is granted */
+        };
+
+        SemaphoreHandle_t _state;               /**< Guards the scheduler fields below */
+        TaskHandle_t _owner = nullptr;          /**< Task holding the card */
+        uint16_t _depth = 0;                    /**< Recursion depth of the owner */
+        StorageIoClass _ownerClass = STORAGE_IO_BACKGROUND; /**< Class the owner holds the card in */
+        Waiter _waiters[STORAGE_MAX_WAITERS] = {};          /**< Queue of tasks waiting for the card */
+        uint32_t _lastRelease[STORAGE_IO_CLASSES] = {};     /**< millis() of the last release per class */
+        StorageClassStats _classStats[STORAGE_IO_CLASSES] = {}; /**< Counters per class */
+
+        MetricsCounter _readBytes;         /**< Bytes read from the card */
+        MetricsCounter _writtenBytes;      /**< Bytes written to the card */
+        MetricsHistogram _readLatency;     /**< Time per read operation */
+        MetricsHistogram _writeLatency;    /**< Time per write operation */
+
+        /**
+         * @brief Hands the free card to the best waiter. Called with _state held.
+         */
+        void _grantNext();
+
+        /**
+         * @brief Counts a grant. Called with _state held.
+         */
+        void _recordGrant(StorageIoClass ioClass, uint32_t waitedUs, bool contended, bool starved);
+};
+
+/**
+ * @class StorageLock
+ * @brief Holds the bus lock of a StorageLib for the lifetime of the object.
+ */
+class StorageLock {
+    public:
+        explicit StorageLock(StorageLib* storage, StorageIoClass ioClass = STORAGE_IO_INTERACTIVE) : _storage(storage) { _storage->lock(ioClass); }
+        ~StorageLock() { _storage->unlock(); }
+
+    private:
+        StorageLib* _storage;
+        StorageLock(const StorageLock&) = delete;
+        StorageLock &operator=(const StorageLock&) = delete;
+};
+
+#endif // STORAGE_LIB
@@ -0,0 +1,139 @@
+/**
+ * @file TraceLib.cpp
+ * @brief Implementation of the TraceLib class.
+ */
+
+#include "TraceLib.h"
+
+#define TRACE_OTHER_TASK 0xFF // Task index of spans from tasks beyond TRACE_MAX_TASKS
+
+// One finished span. `sequence` is 0 while the slot is being written and the slot's position in
+// the ring plus one afterwards, so the exporter can skip slots that are torn or overwritten.
+struct TraceEvent {
+    int64_t start;
+    uint32_t duration;
+    const char* name;
+    uint8_t task;
+    uint32_t sequence;
+};
+
+#if TRACE_ENABLED
+static TraceEvent traceEvents[TRACE_CORES][TRACE_EVENTS_PER_CORE];
+static uint32_t traceHeads[TRACE_CORES] = {}; // Spans ever recorded per core
+
+// Task names are copied on first sight, since a task (a boot phase, say) may be gone by export time
+static TaskHandle_t traceTasks[TRACE_MAX_TASKS] = {};
+static char traceTaskNames[TRACE_MAX_TASKS][TRACE_TASK_NAME_SIZE];
+static portMUX_TYPE traceTaskMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint8_t getTaskIndex() {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < TRACE_MAX_TASKS; i++) {
+        TaskHandle_t task = __atomic_load_n(&traceTasks[i], __ATOMIC_ACQUIRE);
+        if (task == self) return i;
+        if (task == nullptr) break;
+    }
+
+    // pcTaskGetName() is not safe inside a critical section, so the name is copied first
+    char name[TRACE_TASK_NAME_SIZE];
+    snprintf(name, sizeof(name), "%s", pcTaskGetName(self));
+
+    uint8_t index = TRACE_OTHER_TASK;
+    portENTER_CRITICAL(&traceTaskMux);
+    for (int i = 0; i < TRACE_MAX_TASKS && index == TRACE_OTHER_TASK; i++) {
+        if (traceTasks[i] == self) {
+            index = i;
+        } else if (traceTasks[i] == nullptr) {
+            memcpy(traceTaskNames[i], name, sizeof(name));
+            __atomic_store_n(&traceTasks[i], self, __ATOMIC_RELEASE);
+            index = i;
+        }
+    }
+    portEXIT_CRITICAL(&traceTaskMux);
+    return index;
+}
+#endif
+
+static volatile bool traceEnabled = true;
+
+void TraceLib::record(const char* name, int64_t start, uint32_t duration) {
+#if TRACE_ENABLED
+    if (!traceEnabled) {
+        return;
+    }
+
+    // A task may move to the other core at any time; the slot is reserved atomically, so that only
+    // decides which ring the span lands in
+    int core = xPortGetCoreID() % TRACE_CORES;
+    uint32_t position = __atomic_fetch_add(&traceHeads[core], 1, __ATOMIC_RELAXED);
+    TraceEvent &event = traceEvents[core][position % TRACE_EVENTS_PER_CORE];
+
+    __atomic_store_n(&event.sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    event.start = start;
+    event.duration = duration;
+    event.name = name;
+    event.task = getTaskIndex();
+    __atomic_store_n(&event.sequence, position + 1, __ATOMIC_RELEASE);
+#else
+    (void)name; (void)start; (void)duration;
+#endif
+}
+
+void TraceLib::setEnabled(bool enabled) {
+    traceEnabled = enabled;
+}
+
+bool TraceLib::isEnabled() {
+    return TRACE_ENABLED && traceEnabled;
+}
+
+void TraceLib::clear() {
+#if TRACE_ENABLED
+    for (int core = 0; core < TRACE_CORES; core++) {
+        for (int i = 0; i < TRACE_EVENTS_PER_CORE; i++) {
+            __atomic_store_n(&traceEvents[core][i].sequence, 0, __ATOMIC_RELAXED);
+        }
+    }
+#endif
+}
+
+size_t TraceLib::printJson(Print &out) {
+    size_t written = 0;
+    out.print("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    // Name the processes (cores) and threads (tasks) first
+    for (int core = 0; core < TRACE_CORES; core++) {
+        out.printf("%s{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"args\":{\"name\":\"core %d\"}}", core ? "," : "", core, core);
+#if TRACE_ENABLED
+        for (int i = 0; i < TRACE_MAX_TASKS; i++) {
+            if (__atomic_load_n(&traceTasks[i], __ATOMIC_ACQUIRE) == nullptr) break;
+            out.printf(",{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", core, i, traceTaskNames[i]);
+        }
+#endif
+        out.printf(",{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"other\"}}", core, TRACE_OTHER_TASK);
+    }
+
+#if TRACE_ENABLED
+    for (int core = 0; core < TRACE_CORES; core++) {
+        uint32_t head = __atomic_load_n(&traceHeads[core], __ATOMIC_ACQUIRE);
+        uint32_t count = head < TRACE_EVENTS_PER_CORE ? head : TRACE_EVENTS_PER_CORE;
+
+        // Oldest first; spans recorded while exporting may replace some of these and are skipped
+        for (uint32_t position = head - count; position != head; position++) {
+            const TraceEvent &slot = traceEvents[core][position % TRACE_EVENTS_PER_CORE];
+            if (__atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE) != position + 1) continue;
+            TraceEvent event = slot;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&slot.sequence, __ATOMIC_RELAXED) != position + 1) continue;
+
+            out.printf(",{\"ph\":\"X\",\"name\":\"%s\",\"pid\":%d,\"tid\":%u,\"ts\":%lld,\"dur\":%lu}",
+                       event.name, core, (unsigned)event.task, (long long)event.start, (unsigned long)event.duration);
+            written++;
+        }
+    }
+#endif
+
+    out.println("]}");
+    return written;
+}
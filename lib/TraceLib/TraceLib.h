@@ -0,0 +1,91 @@
+/**
+ * @file TraceLib.h
+ * @brief Trace library: scoped spans recorded into per-core ring buffers and exported as
+ *        Chrome trace_event JSON, for viewing in Perfetto or chrome://tracing.
+ */
+
+#ifndef TRACE_LIB
+#define TRACE_LIB
+
+#include <Arduino.h>
+#include "EssentialsLib.h"
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1              /**< Set to 0 in build_flags to compile every TRACE_SCOPE out */
+#endif
+#ifndef TRACE_EVENTS_PER_CORE
+#define TRACE_EVENTS_PER_CORE 256    /**< Spans kept per core; older ones are overwritten */
+#endif
+#define TRACE_CORES 2                /**< Cores with their own ring buffer */
+#define TRACE_MAX_TASKS 16           /**< Distinct task names remembered for the export */
+#define TRACE_TASK_NAME_SIZE 16      /**< Longest task name kept, terminator included */
+
+/**
+ * @class TraceLib
+ * @brief Records finished spans (name, start, duration, task) into one ring buffer per core.
+ *        Recording reserves a slot with an atomic add and never blocks, so it is safe from any
+ *        task; a span is only visible once it has ended.
+ */
+class TraceLib {
+    public:
+        /**
+         * @brief Records a finished span on the ring buffer of the calling core.
+         * @param name Span name; must outlive the trace (a string literal).
+         * @param start Start time from EssentialsLib::getMicros().
+         * @param duration Length of the span in microseconds.
+         */
+        static void record(const char* name, int64_t start, uint32_t duration);
+
+        /**
+         * @brief Pauses or resumes recording; spans already recorded are kept.
+         */
+        static void setEnabled(bool enabled);
+
+        /**
+         * @brief Whether spans are being recorded.
+         */
+        static bool isEnabled();
+
+        /**
+         * @brief Forgets every recorded span.
+         */
+        static void clear();
+
+        /**
+         * @brief Writes the recorded spans as a Chrome trace_event JSON object. Each core is a
+         *        process and each task a thread; times are microseconds since boot.
+         * @return Number of spans written.
+         */
+        static size_t printJson(Print &out);
+};
+
+/**
+ * @class TraceSpan
+ * @brief Records a span from its construction to its destruction. Use through TRACE_SCOPE.
+ */
+class TraceSpan {
+    public:
+        explicit TraceSpan(const char* name) : _name(name), _start(EssentialsLib::getMicros()) {}
+        ~TraceSpan() { TraceLib::record(_name, _start, (uint32_t)(EssentialsLib::getMicros() - _start)); }
+
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+
+    private:
+        const char* _name; /**< Span name */
+        int64_t _start;    /**< Start time in microseconds since boot */
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#if TRACE_ENABLED
+/**
+ * @brief Traces the rest of the enclosing scope as a span named `name` (a string literal).
+ */
+#define TRACE_SCOPE(name) TraceSpan TRACE_CONCAT(_traceSpan, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) do {} while (0)
+#endif
+
+#endif // TRACE_LIB
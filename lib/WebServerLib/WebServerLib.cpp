@@ -1,169 +1,627 @@
 #include "WebServerLib.h"
+#include <EssentialsLib.h>
+#include <TraceLib.h>
+#include <limits.h>
 
-WebServerLib::WebServerLib(const char* ssid, const char* password, LoggerLib* logger, LoaderLib* loader)
-    : server(80), _ssid(ssid), _password(password), _logger(logger), _loader(loader) {}
+static const char* LOG_TAG = "WEB";
+
+#define HTTP_ROUTE_EXACT 12 // The first routes are endpoints matched exactly
+
+const char* const WebServerLib::routeNames[HTTP_ROUTE_COUNT] = {
+    "/log/level", "/log/stats", "/log/query", "/log/gzip", "/log/gzip/stats", "/debug/heap", "/storage",
+    "/storage/stats", "/storage/bench", "/boot", "/metrics", "/trace", "/load-preview", "/load-program", "/", "file"
+};
+
+WebServerLib::WebServerLib(const char* ssid, const char* password, LoggerLib* logger, LoaderLib* loader, StorageLib* storage)
+    : server(80), _logger(logger), _loader(loader), _storage(storage), _ssid(ssid), _password(password) {}
 
 void WebServerLib::begin() {
-    // Connect to Wi-Fi network
-    WiFi.softAP(_ssid, _password);
-    while (WiFi.status() != WL_CONNECTED) {
-        delay(500);
-        _logger->log("Connecting to Wi-Fi...");
-    }
-    _logger->log("Connected to Wi-Fi, IP: " + String(WiFi.localIP().toString()));
-    
+    startAccessPoint();
+
+    //Generate the main menu for picking the new program to load.
+    generateMainMenu();
+}
+
+bool WebServerLib::startAccessPoint() {
+    // softAP() returns once the access point is up; there is no station connection to wait for
+    bool started = WiFi.softAP(_ssid, _password);
+    if (started) {
+        LOG_I(_logger, LOG_TAG, "Access point %s up, IP: %s", _ssid, WiFi.softAPIP().toString().c_str());
+    } else {
+        LOG_E(_logger, LOG_TAG, "Failed to start access point %s", _ssid);
+    }
+
     // Begin the server
     server.begin();
-    
-    //Generate the main menu for picking the new program to load.
-    _generateMainMenuFile();
+    return started;
 }
 
-void WebServerLib::handleClient(SemaphoreHandle_t &logFileMutex, SemaphoreHandle_t &logHTMLFileMutex) {
+void WebServerLib::handleClient() {
     WiFiClient client = server.available();   // Listen for incoming clients
 
     if (client) {                             // If a new client connects,
-        _logger->log("New Client connected.");
+        LOG_V(_logger, LOG_TAG, "New Client connected.");
         // Set a timeout for reading client data
         client.setTimeout(5000); // 5 seconds timeout
-        _serveHTML(client, logFileMutex, logHTMLFileMutex);                    // Serve the HTML page
+        _serveHTML(client);                       // Serve the HTML page
         client.stop();                        // Close the connection
-        _logger->log("Client disconnected.");
+        if (_firstRequestTime == 0) {
+            _firstRequestTime = millis();
+            LOG_I(_logger, LOG_TAG, "First request answered %lu ms after reset", (unsigned long)_firstRequestTime);
+        }
+        LOG_V(_logger, LOG_TAG, "Client disconnected.");
     }
 }
 
-void WebServerLib::_serveHTML(WiFiClient &client, SemaphoreHandle_t &latestLogFileMutex, SemaphoreHandle_t &logHTMLFileMutex) {
-    String header;
-    String currentLine = "";
+void WebServerLib::_serveHTML(WiFiClient &client) {
+    HeapAllocProbe probe;
+    int64_t requestStart = EssentialsLib::getMicros();
+    size_t route = HTTP_ROUTE_COUNT; // Set once the request has been read
+    char requestLine[HTTP_REQUEST_LINE_SIZE]; // Only the first header line is kept, the rest is skipped
+    size_t requestLineLength = 0;
+    bool requestLineDone = false;
     unsigned long startTime = millis(); // Start time for timeout check
-    char lastc = client.read();
+    char lastc = '\0';
 
     while (client.connected() && (millis() - startTime < 5000)) { // Timeout after 5 seconds
         if (client.available()) {
             char c = client.read();
-            header += c;
+            if (!requestLineDone) {
+                if (c == '\n') {
+                    requestLineDone = true;
+                } else if (c != '\r' && requestLineLength < sizeof(requestLine) - 1) {
+                    requestLine[requestLineLength++] = c;
+                }
+            }
 
             if (c == '\n' && lastc == '\n') {
-                _logger->log("Serving HTML.");
+                requestLine[requestLineLength] = '\0';
+
+                // Requests that are answered by the firmware itself rather than from the SD card
+                char target[HTTP_PATH_SIZE];
+                _getRequestTarget(requestLine, target, sizeof(target));
+                route = _getRoute(target);
+                if (_handleLogLevelRequest(client, target) || _handleLogStatsRequest(client, target) || _handleLogQueryRequest(client, target) || _handleLogGzipRequest(client, target) || _handleHeapRequest(client, target) || _handleStorageRequest(client, target) || _handleBootRequest(client, target) || _handleMetricsRequest(client, target) || _handleTraceRequest(client, target)) {
+                    _lastRoutingAllocations = probe.allocations();
+                    _lastRequestAllocations = _lastRoutingAllocations;
+                    break;
+                }
+
+                // Pages and programs live on the card; without it, say so instead of a 404 for everything
+                if (!_storage->isMounted()) {
+                    _sendHeader(client, "503 Service Unavailable", "text/html");
+                    client.println("<html><body><h1>SD card not mounted</h1><p>Insert the card and reset the board. <a href=\"/boot\">/boot</a> and <a href=\"/storage\">/storage</a> show details.</p></body></html>");
+                    _lastRoutingAllocations = probe.allocations();
+                    _lastRequestAllocations = _lastRoutingAllocations;
+                    break;
+                }
+
+                LOG_V(_logger, LOG_TAG, "Serving HTML.");
 
                 // Send response headers
-                client.println("HTTP/1.1 200 OK");
-                client.println("Content-type:text/html");
-                client.println("Connection: close");
-                client.println();
+                _sendHeader(client, "200 OK", "text/html");
 
                 // Parse the requested URL
-                String fileName = _getRequestedFile(header);
-
-                if (fileName == "/log/index.html"){_logger->log("Started creating an HTML file: " + fileName); _logger->updateHtmlLog(latestLogFileMutex, logHTMLFileMutex); _logger->log("Done creating an HTML file: " + fileName);}
-                if (fileName.indexOf("load-preview") != -1) { fileName.replace("load-preview", "Programs"); fileName.replace("%20", " "); }
-                if (fileName.indexOf("load-program") != -1) { fileName.replace("load-program", "Programs"); fileName.replace("%20", " "); fileName.replace("index.html", "firmware.bin"); _loader->update(fileName);}
-
-                if (xSemaphoreTake(logHTMLFileMutex, portMAX_DELAY) == pdTRUE) {
-                    // Read HTML file from SD card
-                    File htmlFile = SD.open(fileName, FILE_READ);
-                    if (htmlFile) {
-                        _logger->log("Start reading " + fileName);
-                        while (htmlFile.available()) {
-                            client.write(htmlFile.read()); // Write the HTML content to the client
-                        }
-                        htmlFile.close(); // Make sure to close the file
-                        _logger->log("Done reading " + fileName);
-                    } else {
-                        client.println("404: Page not found");
-                        _logger->log("Error: Could not open " + fileName);
+                char fileName[HTTP_PATH_SIZE];
+                _getRequestedFile(target, fileName, sizeof(fileName));
+
+                if (strcmp(fileName, "/log/index.html") == 0) {LOG_D(_logger, LOG_TAG, "Started creating an HTML file: %s", fileName); _logger->updateHtmlLog(); LOG_D(_logger, LOG_TAG, "Done creating an HTML file: %s", fileName);}
+                if (strstr(fileName, "load-preview") != nullptr) { _replaceFirst(fileName, sizeof(fileName), "load-preview", "Programs"); _urlDecode(fileName); }
+                if (strstr(fileName, "load-program") != nullptr) { _replaceFirst(fileName, sizeof(fileName), "load-program", "Programs"); _urlDecode(fileName); _replaceFirst(fileName, sizeof(fileName), "index.html", "firmware.bin"); _loader->update(fileName);}
+                _lastRoutingAllocations = probe.allocations();
+
+                // Read HTML file from SD card; the card is only held while a chunk is read, not while it is sent
+                _storage->lock();
+                File htmlFile = _storage->fs().open(fileName, FILE_READ);
+                _storage->unlock();
+                if (htmlFile) {
+                    LOG_V(_logger, LOG_TAG, "Start reading %s", fileName);
+                    int64_t copyStart = EssentialsLib::getMicros();
+                    size_t copied = _copyFile(htmlFile, client); // Write the HTML content to the client
+                    if (strncmp(fileName, "/log/", 5) == 0 || strncmp(fileName, "/Old logs/", 10) == 0) {
+                        // Baseline for the speedup reported at GET /log/gzip/stats
+                        _plainLogBytesTotal += copied;
+                        _plainLogMicrosTotal += (uint64_t)(EssentialsLib::getMicros() - copyStart);
                     }
-                    xSemaphoreGive(logHTMLFileMutex);
+                    _storage->lock();
+                    htmlFile.close(); // Make sure to close the file
+                    _storage->unlock();
+                    LOG_V(_logger, LOG_TAG, "Done reading %s", fileName);
                 } else {
-                    client.println("403: Forbidden");
-                    _logger->log("Error: Could not open " + fileName);
+                    client.println("404: Page not found");
+                    LOG_W(_logger, LOG_TAG, "Error: Could not open %s", fileName);
                 }
 
+                _lastRequestAllocations = probe.allocations();
                 break; // Break out of the while loop after serving
             } else if (c != '\r') { // If you got anything else but a carriage return character,
                 lastc = c;
-                currentLine += c; // Add it to the end of the currentLine
             }
         }
     }
+
+    if (route < HTTP_ROUTE_COUNT) {
+        uint32_t duration = (uint32_t)(EssentialsLib::getMicros() - requestStart);
+        _routeLatency[route].observe(duration);
+        TraceLib::record(routeNames[route], requestStart, duration);
+    }
+}
+
+size_t WebServerLib::_getRoute(const char* target) {
+    size_t pathLength = strcspn(target, "?");
+    for (size_t i = 0; i < HTTP_ROUTE_EXACT; i++) {
+        if (strlen(routeNames[i]) == pathLength && strncmp(target, routeNames[i], pathLength) == 0) {
+            return i;
+        }
+    }
+    if (strncmp(target, "/load-preview/", 14) == 0) return HTTP_ROUTE_EXACT;
+    if (strncmp(target, "/load-program/", 14) == 0) return HTTP_ROUTE_EXACT + 1;
+    if (pathLength == 1) return HTTP_ROUTE_EXACT + 2; // The main menu
+    return HTTP_ROUTE_COUNT - 1;
+}
+
+void WebServerLib::_sendHeader(WiFiClient &client, const char* status, const char* contentType, const char* extraHeaders) {
+    client.print("HTTP/1.1 ");
+    client.println(status);
+    client.print("Content-type:");
+    client.println(contentType);
+    if (extraHeaders != nullptr) {
+        client.print(extraHeaders);
+    }
+    client.println("Connection: close");
+    client.println();
+}
+
+size_t WebServerLib::_copyFile(File &source, Print &destination) {
+    uint8_t buffer[HTTP_COPY_CHUNK_SIZE];
+    size_t total = 0;
+    size_t count;
+    while ((count = _storage->read(source, buffer, sizeof(buffer))) > 0) {
+        total += destination.write(buffer, count);
+    }
+    return total;
+}
+
+// Function to extract the raw request target (path and query) from the HTTP request line
+void WebServerLib::_getRequestTarget(const char* requestLine, char* target, size_t size) {
+    const char* start = strchr(requestLine, ' '); // Start after the GET
+    start = start ? start + 1 : requestLine;
+    const char* end = strchr(start, ' '); // Find the next space
+    size_t length = end ? (size_t)(end - start) : strlen(start);
+
+    snprintf(target, size, "%.*s", (int)length, start);
+}
+
+// Function to extract one "name=value" parameter from the query string of a request target
+bool WebServerLib::_getQueryParam(const char* target, const char* name, char* value, size_t size) {
+    const char* query = strchr(target, '?');
+    if (query == nullptr) {
+        return false;
+    }
+
+    size_t nameLength = strlen(name);
+    const char* param = query + 1;
+    while (*param != '\0') {
+        const char* end = strchr(param, '&');
+        if (end == nullptr) end = param + strlen(param);
+        if ((size_t)(end - param) > nameLength && strncmp(param, name, nameLength) == 0 && param[nameLength] == '=') {
+            const char* start = param + nameLength + 1;
+            snprintf(value, size, "%.*s", (int)(end - start), start);
+            return true;
+        }
+        param = (*end == '&') ? end + 1 : end;
+    }
+    return false;
+}
+
+// Handles GET /log/level[?tag=WEB&level=DEBUG]: optionally changes a threshold, then lists them all
+bool WebServerLib::_handleLogLevelRequest(WiFiClient &client, const char* target) {
+    if (strncmp(target, "/log/level", 10) != 0 || (target[10] != '\0' && target[10] != '?')) {
+        return false;
+    }
+
+    char levelName[16];
+    if (_getQueryParam(target, "level", levelName, sizeof(levelName))) {
+        char tag[LOGGER_TAG_SIZE];
+        if (!_getQueryParam(target, "tag", tag, sizeof(tag)) || tag[0] == '\0') {
+            strcpy(tag, "*");
+        }
+
+        LogLevel level;
+        if (!LoggerLib::parseLevel(levelName, level)) {
+            _sendHeader(client, "400 Bad Request", "text/plain");
+            client.print("Unknown level: ");
+            client.println(levelName);
+            return true;
+        }
+        if (!_logger->setLevel(tag, level)) {
+            _sendHeader(client, "507 Insufficient Storage", "text/plain");
+            client.println("Too many tags with their own level");
+            return true;
+        }
+        LOG_I(_logger, LOG_TAG, "Log level of %s set to %s", tag, LoggerLib::levelName(level));
+    }
+
+    _sendHeader(client, "200 OK", "text/plain");
+    _logger->printLevels(client);
+    return true;
 }
 
-// Function to extract the requested file name from the HTTP header
-String WebServerLib::_getRequestedFile(const String& header) {
-    int startIndex = header.indexOf(' ') + 1; // Start after the GET
-    int endIndex = header.indexOf(' ', startIndex); // Find the next space
+// Handles GET /log/stats: written, dropped and coalesced line counters
+bool WebServerLib::_handleLogStatsRequest(WiFiClient &client, const char* target) {
+    if (strcmp(target, "/log/stats") != 0) {
+        return false;
+    }
+
+    _sendHeader(client, "200 OK", "text/plain");
+    _logger->printStats(client);
+    return true;
+}
+
+// Handles GET /log/query?file=full|N&from=T1&to=T2&match=X: lines of one log in a time range
+bool WebServerLib::_handleLogQueryRequest(WiFiClient &client, const char* target) {
+    if (strncmp(target, "/log/query", 10) != 0 || (target[10] != '\0' && target[10] != '?')) {
+        return false;
+    }
+
+    char file[12] = "full";
+    char value[24];
+    char match[64] = "";
+    unsigned long from = 0;
+    unsigned long to = ULONG_MAX;
+    _getQueryParam(target, "file", file, sizeof(file));
+    if (_getQueryParam(target, "match", match, sizeof(match))) {
+        _urlDecode(match);
+    }
+    if ((_getQueryParam(target, "from", value, sizeof(value)) && !EssentialsLib::parseTimestamp(value, from)) ||
+        (_getQueryParam(target, "to", value, sizeof(value)) && !EssentialsLib::parseTimestamp(value, to))) {
+        _sendHeader(client, "400 Bad Request", "text/plain");
+        client.println("from/to must be milliseconds or HH:MM:SS[:mmm]");
+        return true;
+    }
+
+    _sendHeader(client, "200 OK", "text/plain");
+    if (_logger->queryLog(client, file, from, to, match) < 0) {
+        client.println("No such log");
+    }
+    return true;
+}
+
+// Handles GET /log/gzip?file=full|N, or ?from=T1&to=T2&match=X across all logs, compressed on the fly
+bool WebServerLib::_handleLogGzipRequest(WiFiClient &client, const char* target) {
+    if (strcmp(target, "/log/gzip/stats") == 0) {
+        // Effective speed counts the log bytes delivered, so it compares directly with the plain file route
+        double gzipKBps = _gzipMicrosTotal ? _gzipInputTotal * 1e6 / 1024.0 / _gzipMicrosTotal : 0;
+        double plainKBps = _plainLogMicrosTotal ? _plainLogBytesTotal * 1e6 / 1024.0 / _plainLogMicrosTotal : 0;
+        _sendHeader(client, "200 OK", "text/plain");
+        client.printf("last_input_bytes=%lu\n", (unsigned long)_lastGzipInput);
+        client.printf("last_output_bytes=%lu\n", (unsigned long)_lastGzipOutput);
+        client.printf("last_ratio=%.2f\n", _lastGzipOutput ? (double)_lastGzipInput / _lastGzipOutput : 0);
+        client.printf("last_ms=%lu\n", (unsigned long)(_lastGzipMicros / 1000));
+        client.printf("input_bytes_total=%llu\n", (unsigned long long)_gzipInputTotal);
+        client.printf("output_bytes_total=%llu\n", (unsigned long long)_gzipOutputTotal);
+        client.printf("ratio=%.2f\n", _gzipOutputTotal ? (double)_gzipInputTotal / _gzipOutputTotal : 0);
+        client.printf("effective_kbps=%.1f\n", gzipKBps);
+        client.printf("plain_bytes_total=%llu\n", (unsigned long long)_plainLogBytesTotal);
+        client.printf("plain_kbps=%.1f\n", plainKBps);
+        client.printf("speedup=%.2f\n", plainKBps > 0 ? gzipKBps / plainKBps : 0);
+        return true;
+    }
+    if (strncmp(target, "/log/gzip", 9) != 0 || (target[9] != '\0' && target[9] != '?')) {
+        return false;
+    }
+
+    char file[12] = "full";
+    char value[24];
+    char match[64] = "";
+    unsigned long from = 0;
+    unsigned long to = ULONG_MAX;
+    bool valid = true;
+    bool hasFrom = _getQueryParam(target, "from", value, sizeof(value));
+    if (hasFrom) valid = EssentialsLib::parseTimestamp(value, from);
+    bool hasTo = _getQueryParam(target, "to", value, sizeof(value));
+    if (hasTo) valid = valid && EssentialsLib::parseTimestamp(value, to);
+    if (!valid) {
+        _sendHeader(client, "400 Bad Request", "text/plain");
+        client.println("from/to must be milliseconds or HH:MM:SS[:mmm]");
+        return true;
+    }
+    if (_getQueryParam(target, "match", match, sizeof(match))) {
+        _urlDecode(match);
+    }
+    bool bundle = hasFrom || hasTo || match[0] != '\0';
+    _getQueryParam(target, "file", file, sizeof(file));
+    if (!bundle && !_logger->hasLog(file)) {
+        _sendHeader(client, "404 Not Found", "text/plain");
+        client.println("No such log");
+        return true;
+    }
 
-    String requestedFile = header.substring(startIndex, endIndex);
+    char disposition[80];
+    if (bundle) {
+        snprintf(disposition, sizeof(disposition), "Content-Disposition: attachment; filename=\"logs.txt.gz\"\r\n");
+    } else if (strcmp(file, "full") == 0) {
+        snprintf(disposition, sizeof(disposition), "Content-Disposition: attachment; filename=\"full.log.gz\"\r\n");
+    } else {
+        snprintf(disposition, sizeof(disposition), "Content-Disposition: attachment; filename=\"log_%s.txt.gz\"\r\n", file);
+    }
+    _sendHeader(client, "200 OK", "application/gzip", disposition);
+
+    TRACE_SCOPE("log.gzip");
+    int64_t start = EssentialsLib::getMicros();
+    _gzip.begin(client);
+    if (bundle) {
+        // Archives oldest first, then the current log; each one only reads the part its index points to.
+        // Every file is from its own boot and times restart at 0, so a header line says where lines came from
+        uint32_t first;
+        uint32_t last;
+        _logger->getArchiveRange(first, last);
+        char number[12];
+        for (uint32_t archive = first; archive <= last && archive != 0; archive++) {
+            snprintf(number, sizeof(number), "%lu", (unsigned long)archive);
+            _gzipLogWindow(number, from, to, match);
+        }
+        _gzipLogWindow("full", from, to, match);
+    } else {
+        _logger->copyLog(_gzip, file);
+    }
+    bool complete = _gzip.finish();
+
+    _lastGzipInput = _gzip.getInputBytes();
+    _lastGzipOutput = _gzip.getOutputBytes();
+    _lastGzipMicros = (uint32_t)(EssentialsLib::getMicros() - start);
+    _gzipInputTotal += _lastGzipInput;
+    _gzipOutputTotal += _lastGzipOutput;
+    _gzipMicrosTotal += _lastGzipMicros;
+    LOG_I(_logger, LOG_TAG, "Sent %s gzipped: %lu -> %lu bytes in %lu ms%s", bundle ? "log bundle" : file,
+          (unsigned long)_lastGzipInput, (unsigned long)_lastGzipOutput, (unsigned long)(_lastGzipMicros / 1000),
+          complete ? "" : " (client gone)");
+    return true;
+}
+
+// Handles GET /storage (card details), /storage/stats (SD scheduler waits) and /storage/bench?run=1&size=KB
+bool WebServerLib::_handleStorageRequest(WiFiClient &client, const char* target) {
+    if (strcmp(target, "/storage") == 0) {
+        _sendHeader(client, "200 OK", "text/plain");
+        _storage->printInfo(client);
+        return true;
+    }
+    if (strcmp(target, "/storage/stats") == 0) {
+        _sendHeader(client, "200 OK", "text/plain");
+        _storage->printStats(client);
+        return true;
+    }
+    if (strncmp(target, "/storage/bench", 14) != 0 || (target[14] != '\0' && target[14] != '?')) {
+        return false;
+    }
+
+    // The run wears the card and locks the logger out, so it has to be asked for explicitly
+    char value[16];
+    if (!_getQueryParam(target, "run", value, sizeof(value)) || strcmp(value, "1") != 0) {
+        _sendHeader(client, "400 Bad Request", "text/plain");
+        client.println("Add run=1 to write and read back a test file; log lines are dropped while it runs");
+        return true;
+    }
+
+    unsigned long sizeKb = 1024;
+    if (_getQueryParam(target, "size", value, sizeof(value))) {
+        sizeKb = strtoul(value, nullptr, 10);
+    }
+    if (sizeKb == 0 || sizeKb > STORAGE_BENCHMARK_MAX_SIZE / 1024) {
+        _sendHeader(client, "400 Bad Request", "text/plain");
+        client.printf("size must be between 1 and %lu (KB)\n", (unsigned long)(STORAGE_BENCHMARK_MAX_SIZE / 1024));
+        return true;
+    }
+
+    StorageBenchmark result = _storage->benchmark(sizeKb * 1024);
+    if (!result.ok) {
+        LOG_E(_logger, LOG_TAG, "Storage benchmark failed on %s", StorageLib::busModeName(_storage->getBusMode()));
+        _sendHeader(client, "500 Internal Server Error", "text/plain");
+        client.println("benchmark failed");
+        return true;
+    }
+    LOG_I(_logger, LOG_TAG, "Storage benchmark %s @ %lu kHz, %lu KB: write %.2f MB/s, read %.2f MB/s",
+          StorageLib::busModeName(_storage->getBusMode()), (unsigned long)_storage->getFrequency(), sizeKb,
+          result.writeMBps, result.readMBps);
+
+    _sendHeader(client, "200 OK", "text/plain");
+    _storage->printInfo(client);
+    client.printf("bench_bytes=%lu\n", (unsigned long)result.bytes);
+    client.printf("write_us=%lu\n", (unsigned long)result.writeUs);
+    client.printf("read_us=%lu\n", (unsigned long)result.readUs);
+    client.printf("write_mbps=%.2f\n", result.writeMBps);
+    client.printf("read_mbps=%.2f\n", result.readMBps);
+    return true;
+}
+
+bool WebServerLib::_handleBootRequest(WiFiClient &client, const char* target) {
+    if (strcmp(target, "/boot") != 0) {
+        return false;
+    }
+
+    _sendHeader(client, "200 OK", "text/plain");
+    if (_boot) {
+        _boot->printReport(client);
+    }
+    client.printf("first_request_ms=%lu\n", (unsigned long)_firstRequestTime);
+    return true;
+}
+
+void WebServerLib::_gzipLogWindow(const char* file, unsigned long from, unsigned long to, const char* match) {
+    char path[40];
+    if (!_logger->hasLog(file) || !_logger->getLogPath(file, path, sizeof(path))) {
+        return; // Archives deleted by retention
+    }
+    _gzip.printf("==> %s <==\n", path);
+    _logger->queryLog(_gzip, file, from, to, match);
+}
+
+// Handles GET /debug/heap: heap allocation counters, to check that steady state does not allocate
+bool WebServerLib::_handleHeapRequest(WiFiClient &client, const char* target) {
+    if (strcmp(target, "/debug/heap") != 0) {
+        return false;
+    }
+
+    _sendHeader(client, "200 OK", "text/plain");
+    EssentialsLib::printHeapAllocCounts(client);
+    client.print("web.last_request.routing_allocations=");
+    client.println((unsigned long)_lastRoutingAllocations);
+    client.print("web.last_request.total_allocations=");
+    client.println((unsigned long)_lastRequestAllocations);
+    client.print("logger.last_line_allocations=");
+    client.println((unsigned long)_logger->getLastLineAllocations());
+    return true;
+}
+
+bool WebServerLib::_handleMetricsRequest(WiFiClient &client, const char* target) {
+    if (strcmp(target, "/metrics") != 0) {
+        return false;
+    }
+
+    _sendHeader(client, "200 OK", "text/plain; version=0.0.4");
+    MetricsLib::printSystemMetrics(client);
+    _logger->printMetrics(client);
+    _storage->printMetrics(client);
+
+    MetricsLib::printHeader(client, "http_request_duration_seconds", "histogram", "Time from accepting a request to the end of its response, per route.");
+    char labels[48];
+    for (size_t i = 0; i < HTTP_ROUTE_COUNT; i++) {
+        if (_routeLatency[i].count() == 0) {
+            continue; // Keep the page short; a route shows up once it has been requested
+        }
+        snprintf(labels, sizeof(labels), "route=\"%s\"", routeNames[i]);
+        _routeLatency[i].print(client, "http_request_duration_seconds", labels);
+    }
+
+    _loader->printMetrics(client);
+    return true;
+}
+
+// Handles GET /trace[?clear=1][&enable=0|1]: the recorded spans as Chrome trace_event JSON
+bool WebServerLib::_handleTraceRequest(WiFiClient &client, const char* target) {
+    if (strncmp(target, "/trace", 6) != 0 || (target[6] != '\0' && target[6] != '?')) {
+        return false;
+    }
+
+    _sendHeader(client, "200 OK", "application/json");
+    size_t spans = TraceLib::printJson(client);
+
+    char value[4];
+    if (_getQueryParam(target, "clear", value, sizeof(value)) && strcmp(value, "1") == 0) {
+        TraceLib::clear();
+    }
+    if (_getQueryParam(target, "enable", value, sizeof(value))) {
+        TraceLib::setEnabled(strcmp(value, "0") != 0);
+    }
+    LOG_D(_logger, LOG_TAG, "Exported %u trace spans", (unsigned)spans);
+    return true;
+}
+
+// Function to extract the requested file name from the request target
+void WebServerLib::_getRequestedFile(const char* target, char* fileName, size_t size) {
     // If the requested file is just the root, return index.html
-    if (requestedFile == "/") {
-        return "/WebInterface/index.html";
+    if (strcmp(target, "/") == 0) {
+        snprintf(fileName, size, "/WebInterface/index.html");
+        return;
     }
 
     // Check if the requested file has an extension by looking for a period (.)
-    if (requestedFile.lastIndexOf('.') == -1) {
+    if (strchr(target, '.') == nullptr) {
         // No extension found, so assume it's a directory
-        return requestedFile + "/index.html";
+        snprintf(fileName, size, "%s/index.html", target);
+        return;
     }
 
     // Return the requested file, ensuring it starts with a "/"
-    return String(requestedFile);
+    snprintf(fileName, size, "%s", target);
+}
+
+bool WebServerLib::_replaceFirst(char* text, size_t size, const char* from, const char* to) {
+    char* match = strstr(text, from);
+    if (match == nullptr) {
+        return false;
+    }
+
+    size_t fromLength = strlen(from);
+    size_t toLength = strlen(to);
+    size_t tailLength = strlen(match + fromLength);
+    if ((size_t)(match - text) + toLength + tailLength >= size) {
+        return false; // Would not fit, leave the text untouched
+    }
+
+    memmove(match + toLength, match + fromLength, tailLength + 1);
+    memcpy(match, to, toLength);
+    return true;
 }
 
-// Function to extract the requested file name from the HTTP header
-void WebServerLib::_generateMainMenuFile() {
-    File htmlFile = SD.open("/WebInterface/index.html", FILE_WRITE); // Open file in write mode
+void WebServerLib::_urlDecode(char* text) {
+    char* out = text;
+    for (const char* in = text; *in != '\0'; in++) {
+        if (in[0] == '%' && isxdigit((unsigned char)in[1]) && isxdigit((unsigned char)in[2])) {
+            char hex[3] = {in[1], in[2], '\0'};
+            *out++ = (char)strtol(hex, nullptr, 16);
+            in += 2;
+        } else {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
+}
+
+// Writes one program entry of the main menu; context is the menu file
+static void writeProgramListItem(const char* programName, void* context) {
+    File* htmlFile = static_cast<File*>(context);
+
+    // Construct the data-info and link; assuming your link format is defined
+    htmlFile->print("<li><a class=\"is-file\" href=\"#\" data-info=\"load-program/");
+    htmlFile->print(programName);
+    htmlFile->print("\" onclick=\"changeIframeSrc('load-preview/");
+    htmlFile->print(programName);
+    htmlFile->print("', this)\">");
+    htmlFile->print(programName);
+    htmlFile->println("</a></li>"); // Write the list item to the HTML file
+}
+
+// Function to generate the main menu file from its two static halves and the program list
+bool WebServerLib::generateMainMenu() {
+    StorageLock lock(_storage);
+    File htmlFile = _storage->fs().open("/WebInterface/index.html", FILE_WRITE); // Open file in write mode
     if (htmlFile) {
         {
-            File tempFile = SD.open("/WebInterface/index-part1.html", FILE_READ); // Open file in write mode
+            File tempFile = _storage->fs().open("/WebInterface/index-part1.html", FILE_READ); // Open file in read mode
             if (tempFile) {
                 // Read content from the first part file and write to index.html
-                while (tempFile.available()) {
-                    htmlFile.write(tempFile.read());
-                }
+                _copyFile(tempFile, htmlFile);
                 tempFile.close(); // Close the first part file
-                _logger->log("Successfully read from index-part1.html");
+                LOG_D(_logger, LOG_TAG, "Successfully read from index-part1.html");
             } else {
-                _logger->log("Error: Could not open index-part1.html");
+                LOG_E(_logger, LOG_TAG, "Error: Could not open index-part1.html");
             }
         }
 
         {
-            // List all programs
-            std::list<String> programs = _loader->listAllPrograms();
-
             // Generate the program list items
             htmlFile.println("<ul>"); // Start the unordered list
-            for (const String& program : programs) {
-                // Extract the directory name from the program path
-                int lastSlashIndex = program.lastIndexOf('/');
-                String programName = (lastSlashIndex != -1) ? program.substring(lastSlashIndex + 1) : program;
-
-                // Construct the data-info and link; assuming your link format is defined
-                String link = "load-program/" + program; // Adjust this as necessary
-                String linkPreview = "load-preview/" + program; // Adjust this as necessary
-                String listItem = "<li><a class=\"is-file\" href=\"#\" data-info=\"" + link + "\" onclick=\"changeIframeSrc('" + linkPreview + "', this)\">" + programName + "</a></li>";
-                htmlFile.println(listItem); // Write the list item to the HTML file
-            }
+            _loader->forEachProgram(writeProgramListItem, &htmlFile);
             htmlFile.println("</ul>"); // End the unordered list
         }
 
         {
-            File tempFile = SD.open("/WebInterface/index-part2.html", FILE_READ); // Open file in write mode
+            File tempFile = _storage->fs().open("/WebInterface/index-part2.html", FILE_READ); // Open file in read mode
             if (tempFile) {
-                // Read content from the first part file and write to index.html
-                while (tempFile.available()) {
-                    htmlFile.write(tempFile.read());
-                }
-                tempFile.close(); // Close the first part file
-                _logger->log("Successfully read from index-part2.html");
+                // Read content from the second part file and write to index.html
+                _copyFile(tempFile, htmlFile);
+                tempFile.close(); // Close the second part file
+                LOG_D(_logger, LOG_TAG, "Successfully read from index-part2.html");
             } else {
-                _logger->log("Error: Could not open index-part2.html");
+                LOG_E(_logger, LOG_TAG, "Error: Could not open index-part2.html");
             }
         }
         htmlFile.close();
-        _logger->log("Successfully generated the index.html file!");
+        LOG_I(_logger, LOG_TAG, "Successfully generated the index.html file!");
+        return true;
     } else {
-        _logger->log("Error: Could not create index.html");
+        LOG_E(_logger, LOG_TAG, "Error: Could not create index.html");
+        return false;
     }
 }
-
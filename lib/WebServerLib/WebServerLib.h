@@ -7,9 +7,17 @@
 #define WEB_SERVER_LIB
 
 #include <WiFi.h>
-#include <SD.h>
 #include "LoggerLib.h"
 #include "LoaderLib.h"
+#include "StorageLib.h"
+#include "BootLib.h"
+#include "MetricsLib.h"
+#include "GzipLib.h"
+
+#define HTTP_REQUEST_LINE_SIZE 256 /**< Longest request line kept; longer ones are truncated */
+#define HTTP_PATH_SIZE 192         /**< Longest request target / file path */
+#define HTTP_COPY_CHUNK_SIZE 512   /**< Chunk size for streaming files to clients */
+#define HTTP_ROUTE_COUNT 16        /**< Routes with their own latency histogram, see WebServerLib::routeNames */
 
 /**
  * @class WebServerLib
@@ -22,49 +30,230 @@ public:
      * @param ssid Wi-Fi SSID for network connection.
      * @param password Wi-Fi password for network connection.
      * @param logger Pointer to an instance of LoggerLib for logging server events.
+     * @param loader Pointer to the LoaderLib used to list and load programs.
+     * @param storage Storage that owns the SD card the pages are served from.
      */
-    WebServerLib(const char* ssid, const char* password, LoggerLib* logger, LoaderLib* loader);
+    WebServerLib(const char* ssid, const char* password, LoggerLib* logger, LoaderLib* loader, StorageLib* storage);
 
     /**
      * @brief Initializes the Wi-Fi connection and checks for the presence of the index.html file on the SD card.
      *        If the file is missing, creates a basic index.html file.
-     * @param mainHTMLFileMutex Semaphore for controlling access to the main HTML file.
+     *        Same as startAccessPoint() followed by generateMainMenu().
      */
     void begin();
 
+    /**
+     * @brief Starts the access point and the server. Connections are accepted from here on and
+     *        answered once handleClient() runs.
+     * @return True if the access point is up.
+     */
+    bool startAccessPoint();
+
+    /**
+     * @brief Generates an index.html for changing the software on the ESP32 from the programs on the SD card.
+     * @return True if the file was written.
+     */
+    bool generateMainMenu();
+
+    /**
+     * @brief Serves the report of a boot sequence at GET /boot.
+     * @param boot Boot sequence to report, nullptr for none.
+     */
+    void setBootReport(const BootLib* boot) { _boot = boot; }
+
     /**
      * @brief Handles incoming client connections, serving HTML files and logging the connection status.
-     * @param logFileMutex Semaphore for controlling access to log files.
-     * @param logHTMLFileMutex Semaphore for controlling access to the log HTML file on the SD card.
      */
-    void handleClient(SemaphoreHandle_t &logFileMutex, SemaphoreHandle_t &logHTMLFileMutex);
+    void handleClient();
+
+    /**
+     * @brief Route labels of the request latency histograms. Endpoints match exactly (query
+     *        ignored), the program pages by prefix, and everything else counts as "file".
+     */
+    static const char* const routeNames[HTTP_ROUTE_COUNT];
 
 private:
     WiFiServer server;        /**< Wi-Fi server instance */
     LoggerLib* _logger;       /**< Pointer to LoggerLib instance for logging */
     LoaderLib* _loader;       /**< Pointer to LoggerLib instance for logging */
+    StorageLib* _storage;     /**< Storage that owns the SD card */
     const char* _ssid;        /**< Wi-Fi SSID */
     const char* _password;    /**< Wi-Fi password */
 
+    volatile uint32_t _lastRoutingAllocations = 0; /**< Heap allocations while parsing and routing the last request */
+    volatile uint32_t _lastRequestAllocations = 0; /**< Heap allocations while serving the last request, file I/O included */
+    const BootLib* _boot = nullptr;                 /**< Boot sequence reported at GET /boot */
+    volatile uint32_t _firstRequestTime = 0;        /**< millis() when the first request was answered, 0 before */
+    MetricsHistogram _routeLatency[HTTP_ROUTE_COUNT]; /**< Request latency per entry of routeNames */
+
+    GzipLib _gzip;                     /**< Compressor of GET /log/gzip, kept here so its window is not on the stack */
+    uint32_t _lastGzipInput = 0;       /**< Log bytes compressed by the last GET /log/gzip */
+    uint32_t _lastGzipOutput = 0;      /**< Bytes it sent */
+    uint32_t _lastGzipMicros = 0;      /**< Time it took, headers excluded */
+    uint64_t _gzipInputTotal = 0;      /**< Log bytes compressed by every GET /log/gzip */
+    uint64_t _gzipOutputTotal = 0;
+    uint64_t _gzipMicrosTotal = 0;
+    uint64_t _plainLogBytesTotal = 0;  /**< Log bytes sent uncompressed by the file route (/log/, /Old logs/) */
+    uint64_t _plainLogMicrosTotal = 0;
+
     /**
      * @brief Serves the requested HTML page to the client.
      * @param client Wi-Fi client requesting the HTML page.
-     * @param latestLogFileMutex Semaphore for controlling access to the latest log file.
-     * @param logHTMLFileMutex Semaphore for controlling access to HTML files on the SD card.
      */
-    void _serveHTML(WiFiClient &client, SemaphoreHandle_t &latestLogFileMutex, SemaphoreHandle_t &logHTMLFileMutex);
+    void _serveHTML(WiFiClient &client);
+
+    /**
+     * @brief Maps a request target to the file to serve.
+     * @param target The request target, e.g. "/load-preview/Main%20OS".
+     * @param fileName Receives the file path, "/WebInterface/index.html" for the root.
+     * @param size Size of the fileName buffer.
+     */
+    void _getRequestedFile(const char* target, char* fileName, size_t size);
+
+    /**
+     * @brief Extracts the raw request target (path plus query string) from the request line.
+     * @param requestLine The first line of the client's request, e.g. "GET / HTTP/1.1".
+     * @param target Receives the request target, e.g. "/log/level?tag=WEB".
+     * @param size Size of the target buffer.
+     */
+    void _getRequestTarget(const char* requestLine, char* target, size_t size);
+
+    /**
+     * @brief Looks up a query string parameter.
+     * @param target Request target as returned by _getRequestTarget().
+     * @param name Parameter name.
+     * @param value Receives the raw parameter value.
+     * @param size Size of the value buffer.
+     * @return True if the parameter is present.
+     */
+    bool _getQueryParam(const char* target, const char* name, char* value, size_t size);
+
+    /**
+     * @brief Writes the status line and headers of a response.
+     * @param client Wi-Fi client to respond to.
+     * @param status Status code and reason, e.g. "200 OK".
+     * @param contentType MIME type of the body.
+     * @param extraHeaders Further header lines, each ending in "\r\n", or nullptr.
+     */
+    void _sendHeader(WiFiClient &client, const char* status, const char* contentType, const char* extraHeaders = nullptr);
+
+    /**
+     * @brief Streams the rest of a file in HTTP_COPY_CHUNK_SIZE chunks.
+     * @param source File to read.
+     * @param destination Client or file to write to.
+     * @return Number of bytes written.
+     */
+    size_t _copyFile(File &source, Print &destination);
+
+    /**
+     * @brief Serves GET /log/level, which lists the runtime log thresholds and changes one
+     *        when `level` (and optionally `tag`, default "*") is given.
+     * @param client Wi-Fi client requesting the page.
+     * @param target Request target.
+     * @return True if the request was for this endpoint and has been answered.
+     */
+    bool _handleLogLevelRequest(WiFiClient &client, const char* target);
 
     /**
-     * @brief Parses the HTTP header to extract the requested file path.
-     * @param header The HTTP header containing the client's request.
-     * @return The requested file path, defaulting to "/index.html" if no specific file is requested.
+     * @brief Serves GET /storage (bus, clock and card details), GET /storage/stats (per-class
+     *        wait times of the SD scheduler) and GET /storage/bench?run=1, which measures read/write
+     *        MB/s on the current bus (optional `size` in KB, default 1024, at most
+     *        STORAGE_BENCHMARK_MAX_SIZE). Without `run=1` nothing is written, so a prefetch or a
+     *        crawler cannot start it. Log lines are dropped while it runs.
+     * @param client Wi-Fi client requesting the page.
+     * @param target Request target.
+     * @return True if the request was for this endpoint and has been answered.
      */
-    String _getRequestedFile(const String &header);
+    bool _handleStorageRequest(WiFiClient &client, const char* target);
 
-    /// @brief Generates an index.html for changing the software on the ESP32.
-    /// @param header The HTTP header containing the client's request.
-    /// @return The contents of the HTML file for the index.html file.
-    void _generateMainMenuFile();
+    /**
+     * @brief Serves GET /boot, the time each boot phase started and took, and when the first
+     *        request was answered.
+     * @param client Wi-Fi client requesting the page.
+     * @param target Request target.
+     * @return True if the request was for this endpoint and has been answered.
+     */
+    bool _handleBootRequest(WiFiClient &client, const char* target);
+
+    /**
+     * @brief Serves GET /log/stats, the logger's written/dropped/coalesced counters and queue depth.
+     * @param client Wi-Fi client requesting the page.
+     * @param target Request target.
+     * @return True if the request was for this endpoint and has been answered.
+     */
+    bool _handleLogStatsRequest(WiFiClient &client, const char* target);
+
+    /**
+     * @brief Serves GET /log/query, the lines of the current log (file=full, default) or of
+     *        archive N (file=N) logged between `from` and `to`, optionally containing `match`.
+     *        Times are milliseconds since boot or HH:MM:SS[:mmm], as in the log timestamps.
+     * @param client Wi-Fi client requesting the page.
+     * @param target Request target.
+     * @return True if the request was for this endpoint and has been answered.
+     */
+    bool _handleLogQueryRequest(WiFiClient &client, const char* target);
+
+    /**
+     * @brief Serves GET /log/gzip, a log compressed on the fly from the SD card to the socket:
+     *        the whole current log (file=full, default) or archive N (file=N), or, when `from`
+     *        and/or `to` are given, the lines of every archive and then the current log in that
+     *        window, optionally containing `match`. GET /log/gzip/stats reports the compression
+     *        ratio and the effective speed against plain downloads of the log files.
+     * @param client Wi-Fi client requesting the page.
+     * @param target Request target.
+     * @return True if the request was for this endpoint and has been answered.
+     */
+    bool _handleLogGzipRequest(WiFiClient &client, const char* target);
+
+    /**
+     * @brief Compresses a "==> path <==" line and then the lines of one log in a time window,
+     *        for the bundles of GET /log/gzip. Logs that no longer exist are skipped.
+     * @param file "full" or an archive number, as for LoggerLib::queryLog().
+     */
+    void _gzipLogWindow(const char* file, unsigned long from, unsigned long to, const char* match);
+
+    /**
+     * @brief Serves GET /debug/heap, the heap allocation counters of the web and logging tasks.
+     * @param client Wi-Fi client requesting the page.
+     * @param target Request target.
+     * @return True if the request was for this endpoint and has been answered.
+     */
+    bool _handleHeapRequest(WiFiClient &client, const char* target);
+
+    /**
+     * @brief Serves GET /metrics, the task, heap, logger, SD card, request latency and firmware
+     *        update metrics in the Prometheus text exposition format.
+     * @param client Wi-Fi client requesting the page.
+     * @param target Request target.
+     * @return True if the request was for this endpoint and has been answered.
+     */
+    bool _handleMetricsRequest(WiFiClient &client, const char* target);
+
+    /**
+     * @brief Serves GET /trace, the spans in the trace ring buffers as Chrome trace_event JSON
+     *        (open in Perfetto). `clear=1` empties the buffers after the export, `enable=0|1`
+     *        pauses or resumes recording.
+     * @param client Wi-Fi client requesting the page.
+     * @param target Request target.
+     * @return True if the request was for this endpoint and has been answered.
+     */
+    bool _handleTraceRequest(WiFiClient &client, const char* target);
+
+    /**
+     * @brief Maps a request target to its index in routeNames.
+     */
+    static size_t _getRoute(const char* target);
+
+    /**
+     * @brief Replaces the first occurrence of a substring in place.
+     * @return False if there is no occurrence or the result would not fit.
+     */
+    static bool _replaceFirst(char* text, size_t size, const char* from, const char* to);
+
+    /**
+     * @brief Decodes %XX escapes in place.
+     */
+    static void _urlDecode(char* text);
 };
 
 #endif // WEB_SERVER_LIB
@@ -1,49 +1,89 @@
 #include <header.h>
 
-// Create instances of the libraries
-LoggerLib logger(CS_PIN, MISO_PIN, MOSI_PIN, CLK_PIN);
-LoaderLib loader(CS_PIN, MISO_PIN, MOSI_PIN, CLK_PIN, &logger);
-WebServerLib webServer("ESP32", "password", &logger, &loader); //Set AP name and password
+static const char* LOG_TAG = "MAIN";
 
-SemaphoreHandle_t logFileMutex;
-SemaphoreHandle_t latestLogFileMutex;
-SemaphoreHandle_t logHTMLFileMutex;
+// Create instances of the libraries
+StorageLib storage(CS_PIN, MISO_PIN, MOSI_PIN, CLK_PIN); // Owns the SD card; mounted once, by the storage boot phase
+LoggerLib logger(&storage);
+LoaderLib loader(&storage, &logger);
+WebServerLib webServer("ESP32", "password", &logger, &loader, &storage); //Set AP name and password
+BootLib boot; // Runs and times the boot phases below, reported at GET /boot
 
 // Task to handle web server requests
-void taskHandleWebServer(void *pvParameters) {
+void taskHandleWebServer(void*) {
+    EssentialsLib::trackHeapAllocations(); // Reported by GET /debug/heap
+    MetricsLib::registerTask("web");        // Reported by GET /metrics
     while (true) {
-        webServer.handleClient(latestLogFileMutex, logHTMLFileMutex); // Handle web server requests
-        vTaskDelay(pdMS_TO_TICKS(100 / portTICK_PERIOD_MS)); // Short delay to prevent blocking
+        uint32_t start = micros();
+        webServer.handleClient(); // Handle web server requests
+        MetricsLib::addTaskBusyTime(micros() - start);
+        vTaskDelay(pdMS_TO_TICKS(10)); // Short delay to prevent blocking
     }
 }
 
 // Static wrapper to call the non-static taskLog method
 void taskHandleLoggingWrapper(void *pvParameters) {
     LoggerLib *logger = static_cast<LoggerLib *>(pvParameters);
-    logger->taskLog(logFileMutex, latestLogFileMutex, &pvParameters); // Call the non-static member function
+    logger->taskLog(&pvParameters); // Call the non-static member function
     vTaskDelay(pdMS_TO_TICKS(1000 / portTICK_PERIOD_MS)); // Short delay to prevent blocking
 }
 
-void setup() {
-    logFileMutex = xSemaphoreCreateMutex();
-    latestLogFileMutex = xSemaphoreCreateMutex();
-    logHTMLFileMutex = xSemaphoreCreateMutex();
-    logger.begin(115200); // Initialize logger
+// Boot phases. Wi-Fi and the SD card come up in parallel; the log files and the menu need the
+// card, and the web server starts as soon as Wi-Fi, the card and the menu are ready (or have failed).
+static bool bootSerial(void*) {
+    logger.beginSerial(115200);
+    return true;
+}
 
-    // Initialize the SD card
+static bool bootStorage(void*) {
+    storage.setBusMode(STORAGE_BUS_MODE);
+    storage.setFrequency(STORAGE_FREQUENCY_KHZ);
+    storage.setSdmmcPins(SDMMC_CLK_PIN, SDMMC_CMD_PIN, SDMMC_D0_PIN, SDMMC_D1_PIN, SDMMC_D2_PIN, SDMMC_D3_PIN);
     if (loader.begin()) {
-        logger.log("SD Card initialized.");
-    } else {
-        logger.log("Failed to initialize SD Card.");
-        return;
+        LOG_I(&logger, LOG_TAG, "SD Card initialized.");
+        return true;
+    }
+    LOG_E(&logger, LOG_TAG, "Failed to initialize SD Card.");
+    return false;
+}
+
+static bool bootWiFi(void*) {
+    return webServer.startAccessPoint();
+}
+
+static bool bootLogFiles(void*) {
+    bool opened = logger.beginLogFiles();
+    // Lines logged so far wait in the queue until the files are open
+    xTaskCreate(taskHandleLoggingWrapper, "HandleLogging", 10240, &logger, 1, NULL);
+    return opened;
+}
+
+static bool bootMenu(void*) {
+    return storage.isMounted() && webServer.generateMainMenu();
+}
+
+static bool bootWebServer(void*) {
+    // Without the card every page is an error page, but /boot and /storage still show what went wrong
+    webServer.setBootReport(&boot);
+    bool started = xTaskCreate(taskHandleWebServer, "HandleWebServer", 8192, NULL, 2, NULL) == pdPASS;
+    if (!storage.isMounted()) {
+        LOG_E(&logger, LOG_TAG, "No SD card: serving an error page only.");
+        return false;
     }
+    return started;
+}
 
-    webServer.begin();
+void setup() {
+    boot.runInline("serial", bootSerial);
+    EventBits_t storageReady = boot.addPhase("storage", bootStorage);
+    EventBits_t wifiReady = boot.addPhase("wifi", bootWiFi);
+    boot.addPhase("log", bootLogFiles, nullptr, storageReady);
+    EventBits_t menuReady = boot.addPhase("menu", bootMenu, nullptr, storageReady, 6144);
+    boot.addPhase("http", bootWebServer, nullptr, wifiReady | storageReady | menuReady);
 
-    // Create tasks for HTML log updating and web server handling
-    xTaskCreate(taskHandleWebServer, "HandleWebServer", 8192, NULL, 2, NULL);
-    // Create the logging task
-    xTaskCreate(taskHandleLoggingWrapper, "HandleLogging", 10240, &logger, 1, NULL);}
+    boot.run();
+    boot.logReport(&logger);
+}
 
 void loop() {
     // Do nothing here, everything is handled by tasks
@@ -0,0 +1,332 @@
+/**
+ * @file main.cpp
+ * @brief HTTP load generator for the web interface. Runs the clients of a scenario file in
+ *        parallel against a device or a host build (env:native) and reports latency
+ *        percentiles, throughput and errors per route. Built by env:loadgen, see platformio.ini.
+ *
+ *        loadgen [--host 192.168.4.1] [--port 80] [--duration 10] [--scale 1] [--timeout 5000]
+ *                [--json] scenario.txt
+ *
+ *        A scenario lists clients; each one repeats its steps until the duration is over:
+ *
+ *            client browser x3           # three of these run at once (times --scale)
+ *              get /                     # route label: the path without the query string
+ *              get /load-preview/Main%20OS as /load-preview
+ *              sleep 500                 # milliseconds
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define LOADGEN_BUFFER_SIZE 16384 // Bytes read from the socket at a time
+
+typedef std::chrono::steady_clock Clock;
+
+struct Step {
+    bool sleep;        // Sleep instead of a request
+    unsigned sleepMs;  // Time to sleep
+    std::string path;  // Request target
+    std::string route; // Label the request is reported under
+};
+
+struct ClientScript {
+    std::string name;
+    unsigned count;
+    std::vector<Step> steps;
+};
+
+struct Options {
+    std::string host = "127.0.0.1";
+    unsigned port = 80;
+    double duration = 10;
+    unsigned scale = 1;
+    unsigned timeoutMs = 5000;
+    bool json = false;
+    std::string scenario;
+};
+
+// What one client measured for one route; merged across clients at the end
+struct RouteStats {
+    std::vector<uint32_t> latencies; // Microseconds, successful requests only
+    uint64_t bytes = 0;              // Body and headers received
+    unsigned requests = 0;
+    unsigned errors = 0;             // Connection failures, timeouts and 4xx/5xx statuses
+
+    void merge(const RouteStats &other) {
+        latencies.insert(latencies.end(), other.latencies.begin(), other.latencies.end());
+        bytes += other.bytes;
+        requests += other.requests;
+        errors += other.errors;
+    }
+};
+
+typedef std::map<std::string, RouteStats> StatsByRoute;
+
+static bool parseScenario(const std::string &fileName, std::vector<ClientScript> &clients) {
+    std::ifstream file(fileName);
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", fileName.c_str());
+        return false;
+    }
+
+    std::string line;
+    unsigned lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string command;
+        if (!(words >> command)) continue;
+
+        if (command == "client") {
+            ClientScript client;
+            std::string count = "x1";
+            words >> client.name >> count;
+            client.count = count.size() > 1 && count[0] == 'x' ? (unsigned)atoi(count.c_str() + 1) : 0;
+            if (client.name.empty() || client.count == 0) {
+                fprintf(stderr, "%s:%u: expected \"client NAME xN\"\n", fileName.c_str(), lineNumber);
+                return false;
+            }
+            clients.push_back(client);
+            continue;
+        }
+
+        if (clients.empty()) {
+            fprintf(stderr, "%s:%u: step before the first client\n", fileName.c_str(), lineNumber);
+            return false;
+        }
+        Step step = {};
+        if (command == "get") {
+            std::string as;
+            words >> step.path >> as >> step.route;
+            if (step.path.empty() || step.path[0] != '/' || (!as.empty() && (as != "as" || step.route.empty()))) {
+                fprintf(stderr, "%s:%u: expected \"get /path [as ROUTE]\"\n", fileName.c_str(), lineNumber);
+                return false;
+            }
+            if (step.route.empty()) step.route = step.path.substr(0, step.path.find('?'));
+        } else if (command == "sleep") {
+            step.sleep = true;
+            if (!(words >> step.sleepMs)) {
+                fprintf(stderr, "%s:%u: expected \"sleep MS\"\n", fileName.c_str(), lineNumber);
+                return false;
+            }
+        } else {
+            fprintf(stderr, "%s:%u: unknown command \"%s\"\n", fileName.c_str(), lineNumber, command.c_str());
+            return false;
+        }
+        clients.back().steps.push_back(step);
+    }
+    return !clients.empty();
+}
+
+// Sends one GET and reads the response until the server closes the connection.
+// Returns the HTTP status, or 0 if the connection failed or timed out.
+static int request(const Options &options, const sockaddr_in &address, const std::string &path, uint64_t &bytes) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return 0;
+    timeval timeout = {(time_t)(options.timeoutMs / 1000), (suseconds_t)(options.timeoutMs % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)); // Also bounds connect() on Linux
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (connect(fd, (const sockaddr*)&address, sizeof(address)) < 0) {
+        close(fd);
+        return 0;
+    }
+
+    std::string header = "GET " + path + " HTTP/1.1\r\nHost: " + options.host + "\r\nConnection: close\r\n\r\n";
+    if (send(fd, header.data(), header.size(), MSG_NOSIGNAL) != (ssize_t)header.size()) {
+        close(fd);
+        return 0;
+    }
+
+    // Only the status line is kept; the rest is counted and discarded
+    char buffer[LOADGEN_BUFFER_SIZE];
+    char statusLine[32] = "";
+    size_t statusLength = 0;
+    bool complete = false;
+    ssize_t count;
+    while ((count = recv(fd, buffer, sizeof(buffer), 0)) != 0) {
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            break; // Timeout or reset
+        }
+        for (ssize_t i = 0; i < count && statusLength < sizeof(statusLine) - 1; i++) {
+            statusLine[statusLength++] = buffer[i];
+        }
+        bytes += count;
+    }
+    complete = count == 0;
+    close(fd);
+
+    statusLine[statusLength] = '\0';
+    int status = 0;
+    if (!complete || sscanf(statusLine, "HTTP/%*d.%*d %d", &status) != 1) {
+        return 0;
+    }
+    return status;
+}
+
+static void runClient(const Options &options, const sockaddr_in &address, const ClientScript &script, Clock::time_point end, StatsByRoute &stats) {
+    while (Clock::now() < end) {
+        for (const Step &step : script.steps) {
+            if (Clock::now() >= end) return;
+            if (step.sleep) {
+                // Never past the end of the run, which would stretch it and understate req/s
+                std::this_thread::sleep_until(std::min(Clock::now() + std::chrono::milliseconds(step.sleepMs), end));
+                continue;
+            }
+
+            RouteStats &route = stats[step.route];
+            uint64_t bytes = 0;
+            Clock::time_point start = Clock::now();
+            int status = request(options, address, step.path, bytes);
+            uint32_t latency = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+
+            route.requests++;
+            route.bytes += bytes;
+            if (status == 0 || status >= 400) {
+                route.errors++;
+            } else {
+                route.latencies.push_back(latency);
+            }
+        }
+    }
+}
+
+// Nearest-rank percentile of sorted latencies, in milliseconds
+static double percentile(const std::vector<uint32_t> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t)(p / 100.0 * sorted.size() + 0.999999);
+    rank = std::min(std::max(rank, (size_t)1), sorted.size());
+    return sorted[rank - 1] / 1000.0;
+}
+
+static void printReport(const Options &options, StatsByRoute &routes, double seconds) {
+    if (options.json) {
+        printf("{\"target\":\"%s:%u\",\"duration_s\":%.3f,\"routes\":[", options.host.c_str(), options.port, seconds);
+    } else {
+        printf("%-24s %8s %6s %9s %9s %9s %9s %8s %9s\n", "route", "requests", "errors", "p50 ms", "p95 ms", "p99 ms", "max ms", "req/s", "KB/s");
+    }
+
+    bool first = true;
+    for (auto &entry : routes) {
+        RouteStats &route = entry.second;
+        std::sort(route.latencies.begin(), route.latencies.end());
+        double maxMs = route.latencies.empty() ? 0 : route.latencies.back() / 1000.0;
+        double rate = route.requests / seconds;
+        double kbPerSecond = route.bytes / 1024.0 / seconds;
+        if (options.json) {
+            printf("%s\n  {\"route\":\"%s\",\"requests\":%u,\"errors\":%u,\"p50_ms\":%.3f,\"p95_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f,\"requests_per_s\":%.3f,\"kb_per_s\":%.3f}",
+                   first ? "" : ",", entry.first.c_str(), route.requests, route.errors,
+                   percentile(route.latencies, 50), percentile(route.latencies, 95), percentile(route.latencies, 99), maxMs, rate, kbPerSecond);
+        } else {
+            printf("%-24s %8u %6u %9.2f %9.2f %9.2f %9.2f %8.2f %9.1f\n", entry.first.c_str(), route.requests, route.errors,
+                   percentile(route.latencies, 50), percentile(route.latencies, 95), percentile(route.latencies, 99), maxMs, rate, kbPerSecond);
+        }
+        first = false;
+    }
+
+    if (options.json) {
+        printf("\n]}\n");
+    }
+}
+
+static bool parseOptions(int argc, char** argv, Options &options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--json") {
+            options.json = true;
+        } else if (arg == "--host" && hasValue) {
+            options.host = argv[++i];
+        } else if (arg == "--port" && hasValue) {
+            options.port = (unsigned)atoi(argv[++i]);
+        } else if (arg == "--duration" && hasValue) {
+            options.duration = atof(argv[++i]);
+        } else if (arg == "--scale" && hasValue) {
+            options.scale = (unsigned)atoi(argv[++i]);
+        } else if (arg == "--timeout" && hasValue) {
+            options.timeoutMs = (unsigned)atoi(argv[++i]);
+        } else if (arg[0] != '-' && options.scenario.empty()) {
+            options.scenario = arg;
+        } else {
+            return false;
+        }
+    }
+    return !options.scenario.empty() && options.port > 0 && options.port < 65536 && options.duration > 0 && options.scale > 0;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        fprintf(stderr, "usage: %s [--host HOST] [--port PORT] [--duration S] [--scale N] [--timeout MS] [--json] SCENARIO\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<ClientScript> scripts;
+    if (!parseScenario(options.scenario, scripts)) {
+        return 2;
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* resolved = nullptr;
+    if (getaddrinfo(options.host.c_str(), nullptr, &hints, &resolved) != 0 || resolved == nullptr) {
+        fprintf(stderr, "Cannot resolve %s\n", options.host.c_str());
+        return 1;
+    }
+    sockaddr_in address = *(const sockaddr_in*)resolved->ai_addr;
+    address.sin_port = htons((uint16_t)options.port);
+    freeaddrinfo(resolved);
+
+    // One thread and one set of counters per simulated client, so nothing is shared while running
+    size_t clientCount = 0;
+    for (const ClientScript &script : scripts) clientCount += script.count * options.scale;
+    std::vector<StatsByRoute> stats(clientCount);
+    std::vector<std::thread> threads;
+    fprintf(stderr, "Running %s with %u clients against %s:%u for %.1f s\n", options.scenario.c_str(), (unsigned)clientCount, options.host.c_str(), options.port, options.duration);
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::microseconds((int64_t)(options.duration * 1e6));
+    size_t next = 0;
+    for (const ClientScript &script : scripts) {
+        for (unsigned i = 0; i < script.count * options.scale; i++) {
+            StatsByRoute &clientStats = stats[next++];
+            threads.emplace_back([&options, &address, &script, end, &clientStats]() {
+                runClient(options, address, script, end, clientStats);
+            });
+        }
+    }
+    for (std::thread &thread : threads) thread.join();
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count() / 1e6;
+
+    StatsByRoute routes;
+    for (const StatsByRoute &clientStats : stats) {
+        for (const auto &entry : clientStats) routes[entry.first].merge(entry.second);
+    }
+    printReport(options, routes, seconds);
+    return 0;
+}